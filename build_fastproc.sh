@@ -0,0 +1,15 @@
+#!/bin/bash
+# Optional: compile the native /proc readers (monitor_host/_fastproc.c).
+# Without them the monitor uses its pure-Python readers.
+
+SCRIPT_DIR="$(cd "$(dirname "$(readlink -f "${BASH_SOURCE[0]}")")" && pwd)"
+cd "$SCRIPT_DIR/monitor_host"
+
+PYTHON="${PYTHON:-$SCRIPT_DIR/.venv/bin/python3}"
+[ -x "$PYTHON" ] || PYTHON=python3
+
+INCLUDE=$("$PYTHON" -c 'import sysconfig; print(sysconfig.get_paths()["include"])')
+SUFFIX=$("$PYTHON" -c 'import sysconfig; print(sysconfig.get_config_var("EXT_SUFFIX"))')
+
+${CC:-cc} -O2 -Wall -shared -fPIC -I"$INCLUDE" _fastproc.c -o "_fastproc$SUFFIX" -lm || exit 1
+echo "Built monitor_host/_fastproc$SUFFIX"
@@ -7,7 +7,10 @@ fi
 
 source .venv/bin/activate
 
-pip install pyserial psutil pynvml platformio
+pip install pyserial pynvml platformio
+
+# Native /proc readers are optional; the monitor falls back to pure Python
+./build_fastproc.sh || echo "Skipping native readers (no C compiler or Python headers)"
 
 cd monitor_firmware
 pio run -t upload
@@ -11,13 +11,14 @@ sudo mkdir -p /opt/cyd-monitor
 sudo cp -r monitor_host /opt/cyd-monitor/
 sudo cp -r monitor_firmware /opt/cyd-monitor/
 sudo cp install.sh /opt/cyd-monitor/
+sudo cp build_fastproc.sh /opt/cyd-monitor/
 sudo cp run.sh /opt/cyd-monitor/
 
 # Create virtual environment
 cd /opt/cyd-monitor
 sudo python3 -m venv .venv
 sudo .venv/bin/pip install --upgrade pip
-sudo .venv/bin/pip install psutil pyserial pynvml
+sudo .venv/bin/pip install pyserial pynvml
 
 # Set permissions
 sudo chown -R $USER:$USER /opt/cyd-monitor
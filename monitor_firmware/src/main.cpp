@@ -2,6 +2,8 @@
 #include <ArduinoJson.h>
 #include <TFT_eSPI.h>
 
+#include "metric_ids.h"
+
 TFT_eSPI tft = TFT_eSPI();
 
 #define COLOR_BG 0x0000
@@ -17,48 +19,225 @@ TFT_eSPI tft = TFT_eSPI();
 #define TOUCH_LEFT_ZONE 80
 #define TOUCH_RIGHT_ZONE 240
 
-enum Mode { MODE_STATS, MODE_REACTOR };
+enum Mode { MODE_STATS, MODE_REACTOR, MODE_CLUSTER, MODE_APP, MODE_WATCH,
+           MODE_NET, MODE_FS, MODE_ENERGY, MODE_HISTORY, MODE_TAILS, MODE_DEBUG,
+           MODE_COUNT };
 Mode currentMode = MODE_REACTOR;
 bool modeChanged = true;
 
-struct SystemStats {
-  float cpu_load = 0;
-  float cpu_temp = 0;
-  int cpu_freq = 0;
-  float cpu_pwr = 0;
-  float cores[16] = {0};
-  int core_count = 0;
-
-  float ram_used = 0;
-  float ram_total = 0;
-  float ram_p = 0;
-
-  float swap_used = 0;
-  float swap_p = 0;
-
-  int cpu_fan = 0;
-
-  int gpu_load = 0;
-  float vram_used = 0;
-  float vram_total = 0;
-  int gpu_temp = 0;
-  float gpu_pwr = 0;
-  int gpu_fan = 0;
-
-  float disk_p = 0;
-  float net_sent = 0;
-  float net_recv = 0;
+// Host metrics indexed by MetricId (metric_ids.h, generated from the host's
+// registry); cores beyond coreCount are not present on the host
+float metric[METRIC_COUNT] = {0};
+int coreCount = 0;
+
+#define MAX_HOSTS 8
+
+// Per-host summary sent by the host when it aggregates remote agents
+struct HostSummary {
+  char name[11];
+  float cpu_load;
+  float cpu_temp;
+  float ram_p;
+  float gpu_load;
+  bool stale;
+};
+HostSummary hosts[MAX_HOSTS];
+int hostCount = 0;
+int hostTotal = 0;
+int hostStale = 0;
+
+#define MAX_CUSTOM 4
+
+// Application metrics pushed to the host over StatsD, log-line rates and
+// probe p99 latencies; a probe that stopped answering is marked down
+struct CustomMetric {
+  char name[9];
+  float value;
+  bool valid;
+  bool down;
+};
+CustomMetric custom[MAX_CUSTOM];
+int customCount = 0;
+
+#define MAX_TOP_THREADS 5
+
+// Watched service sampled at high rate by the host (--watch)
+struct WatchStats {
+  bool present = false;
+  bool up = false;
+  char name[13] = "";
+  int pid = 0;
+  int restarts = 0;
+  float cpu = 0;
+  float cpu_peak = 0;
+  float rss = 0;
+  int fds = 0;
+  int threads = 0;
+  float ctx_switches = 0;
+  float io_read = 0;
+  float io_write = 0;
+  int top_count = 0;
+  char top_name[MAX_TOP_THREADS][11];
+  float top_cpu[MAX_TOP_THREADS];
+};
+WatchStats watch;
+
+// TCP/UDP error counter rates per second from /proc/net/snmp and netstat
+struct ProtoHealth {
+  bool present = false;
+  float retrans = 0;
+  float retransPct = 0;
+  float timeouts = 0;
+  float listenOverflows = 0;
+  float listenDrops = 0;
+  float resets = 0;
+  float attemptFails = 0;
+  float tcpInErrs = 0;
+  float udpInErrs = 0;
+  float udpRcvbuf = 0;
+  float udpNoPorts = 0;
+  int established = 0;
+};
+ProtoHealth proto;
+
+#define MAX_FS_ROWS 5
+
+// Real filesystems from the host, fullest first; hoursToFull < 0 means the
+// usage is not growing, stale means statvfs did not answer in time
+struct FsRow {
+  char mount[13];
+  float pct;
+  float inodePct;
+  float usedGb;
+  float totalGb;
+  float hoursToFull;
+  bool stale;
+};
+FsRow fsRows[MAX_FS_ROWS];
+int fsCount = 0;
+
+#define MAX_ENERGY_ROWS 4
+
+// Energy per domain from the host's counters (--energy): watts now and Wh
+// over the last hour and day; kwh is the lifetime total kept by the host
+struct EnergyRow {
+  char name[7];
+  float watts;
+  float whHour;
+  float whDay;
+};
+EnergyRow energyRows[MAX_ENERGY_ROWS];
+int energyCount = 0;
+float energyHour = 0;
+float energyDay = 0;
+float energyKwh = 0;
+
+#define MAX_TAIL_ROWS 6
+
+// Windowed p50/p95/p99 computed by the host (--tails)
+struct TailRow {
+  char name[11];
+  int window;
+  float p50;
+  float p95;
+  float p99;
+};
+TailRow tails[MAX_TAIL_ROWS];
+int tailCount = 0;
+
+// Rows on the STATS page that host alerts and anomaly flags refer to
+#define LINE_CPU 1
+#define LINE_GPU 2
+#define LINE_PWR 4
+#define LINE_VRAM 8
+#define LINE_RAM 16
+#define LINE_SWAP 32
+#define LINE_DISK 64
+
+// Anomaly flags from the host; absent from the frame when nothing is flagged
+struct Anomaly {
+  uint8_t lines = 0;
+  uint16_t cores = 0;
+  int count = 0;
+  char text[25] = "";
 };
-SystemStats stats;
+Anomaly anomaly;
+
+#define ALERT_BANNER_MS 5000
+#define ALERT_CLEAR_MS 2000
+
+// Alert state evaluated by the host rule engine; the stats frame carries the
+// active rows and {"t":"alert"} frames announce each change
+struct AlertState {
+  uint8_t warn = 0;
+  uint8_t crit = 0;
+  int count = 0;
+  char name[9] = "";
+  float value = 0;
+  bool on = false;
+  bool critical = false;
+  unsigned long changedAt = 0;
+};
+AlertState alerts;
+
+// micros() stamps for the last stats frame that carried an "id"; reported
+// back as one {"t":"tr"} line after it is drawn (host latency + --trace)
+struct FrameTrace {
+  long id = 0;
+  uint32_t rx = 0;
+  uint32_t rxDur = 0;
+  uint32_t parse = 0;
+  uint32_t parseDur = 0;
+  uint32_t draw = 0;
+  uint32_t drawDur = 0;
+  uint32_t push = 0;
+  uint32_t pushDur = 0;
+};
+FrameTrace frameTrace;
+
+// The host monitor's own cost, measured by its overhead governor
+struct MonitorCost {
+  bool present = false;
+  float cpu = 0;
+  float budget = 0;
+  int tick_us = 0;
+  float rss = 0;
+  char throttled[25] = "";
+};
+MonitorCost monitorCost;
+
+// Sample-to-pixel latency percentiles computed by the host from the "tr"
+// echoes, p50/p99 in ms; negative until the host has a value
+struct Latency {
+  float total[2] = {-1, -1};
+  float host[2] = {-1, -1};
+  float uart[2] = {-1, -1};
+  float parse[2] = {-1, -1};
+  float draw[2] = {-1, -1};
+  float push[2] = {-1, -1};
+};
+Latency latency;
 
 unsigned long lastDataTime = 0;
 bool isConnected = false;
 
+// Link rate: boots at BOOT_BAUD; the host can switch it with
+// {"t":"baud","v":N}. Until a frame parses at the new rate the previous one
+// is kept, and restored after BAUD_CONFIRM_MS
+#define BOOT_BAUD 115200
+#define BAUD_CONFIRM_MS 5000
+uint32_t linkBaud = BOOT_BAUD;
+uint32_t fallbackBaud = 0;
+unsigned long baudSwitchedAt = 0;
+
 // Use a sprite for flicker-free updates
 TFT_eSprite spr = TFT_eSprite(&tft);
 
 void setup() {
-  Serial.begin(115200);
+  // History frames are ~1 KB; keep them from overflowing the default 256 B
+  // buffer while a redraw is in progress
+  Serial.setRxBufferSize(4096);
+  Serial.begin(BOOT_BAUD);
 
   pinMode(0, INPUT_PULLUP);
 
@@ -97,6 +276,46 @@ void drawLine(int y, String label, String value, uint16_t color) {
   spr.drawString(value, 310, y, 2);
 }
 
+String formatValue(float v) {
+  if (fabs(v) >= 1000)
+    return String((long)v);
+  return String(v, 1);
+}
+
+uint16_t alertColor(uint8_t line) {
+  if (alerts.crit & line)
+    return COLOR_BRIGHT;
+  if (alerts.warn & line)
+    return COLOR_WARN;
+  return COLOR_TEXT;
+}
+
+// Every page ends here so a fresh alert is visible whatever page is shown
+void pushScreen() {
+  unsigned long age = millis() - alerts.changedAt;
+  if (alerts.changedAt != 0 &&
+      age < (alerts.on ? ALERT_BANNER_MS : ALERT_CLEAR_MS)) {
+    uint16_t bg = alerts.on ? COLOR_WARN : COLOR_DIM;
+    spr.fillRect(0, 0, SCREEN_W, 18, bg);
+    spr.setTextDatum(MC_DATUM);
+    spr.setTextColor(COLOR_BG, bg);
+    String text = String(alerts.on ? (alerts.critical ? "CRIT " : "ALERT ")
+                                   : "OK ") +
+                  alerts.name;
+    if (alerts.on)
+      text += " " + formatValue(alerts.value);
+    spr.drawString(text, SCREEN_W / 2, 9, 2);
+  }
+  frameTrace.push = micros();
+  spr.pushSprite(0, 0);
+  frameTrace.pushDur = micros() - frameTrace.push;
+}
+
+void drawAnomalyMark(int y, uint8_t line) {
+  if (anomaly.lines & line)
+    spr.fillTriangle(1, y + 3, 1, y + 13, 6, y + 8, COLOR_WARN);
+}
+
 void drawStatsScreen() {
   spr.fillScreen(COLOR_BG);
   spr.setTextDatum(MC_DATUM);
@@ -106,47 +325,63 @@ void drawStatsScreen() {
   int y = 50;
   int s = 22;
 
-  uint16_t cpuColor = (stats.cpu_load > 80) ? COLOR_WARN : COLOR_TEXT;
+  uint16_t cpuColor = alertColor(LINE_CPU);
+  drawAnomalyMark(y, LINE_CPU);
   drawLine(y, "CPU",
-           String((int)stats.cpu_load) + "% " + String((int)stats.cpu_temp) +
+           String((int)metric[M_CPU_LOAD]) + "% " + String((int)metric[M_CPU_TEMP]) +
                "C",
            cpuColor);
   y += s;
 
-  uint16_t gpuColor = (stats.gpu_load > 80) ? COLOR_WARN : COLOR_TEXT;
+  uint16_t gpuColor = alertColor(LINE_GPU);
+  drawAnomalyMark(y, LINE_GPU);
   drawLine(y, "GPU",
-           String(stats.gpu_load) + "% " + String(stats.gpu_temp) + "C",
+           String((int)metric[M_GPU_GPU_LOAD]) + "% " + String((int)metric[M_GPU_GPU_TEMP]) + "C",
            gpuColor);
   y += s;
 
-  drawLine(y, "PWR", String((int)stats.gpu_pwr) + "W", COLOR_TEXT);
+  drawAnomalyMark(y, LINE_PWR);
+  drawLine(y, "PWR", String((int)metric[M_GPU_GPU_PWR]) + "W", alertColor(LINE_PWR));
   y += s;
 
+  drawAnomalyMark(y, LINE_VRAM);
   drawLine(y, "VRAM",
-           String(stats.vram_used / 1024.0, 1) + "/" +
-               String(stats.vram_total / 1024.0, 1) + "GB",
-           COLOR_TEXT);
+           String(metric[M_GPU_VRAM_USED] / 1024.0, 1) + "/" +
+               String(metric[M_GPU_VRAM_TOTAL] / 1024.0, 1) + "GB",
+           alertColor(LINE_VRAM));
   y += s;
 
-  uint16_t ramColor = (stats.ram_p > 85) ? COLOR_WARN : COLOR_TEXT;
+  uint16_t ramColor = alertColor(LINE_RAM);
+  drawAnomalyMark(y, LINE_RAM);
   drawLine(y, "RAM",
-           String(stats.ram_used, 1) + "/" + String(stats.ram_total, 1) + "GB",
+           String(metric[M_RAM_USED], 1) + "/" + String(metric[M_RAM_TOTAL], 1) + "GB",
            ramColor);
   y += s;
 
-  uint16_t swapColor = (stats.swap_p > 50) ? COLOR_WARN : COLOR_TEXT;
-  drawLine(y, "SWAP", String((int)stats.swap_p) + "%", swapColor);
+  uint16_t swapColor = alertColor(LINE_SWAP);
+  drawAnomalyMark(y, LINE_SWAP);
+  drawLine(y, "SWAP", String((int)metric[M_SWAP_P]) + "%", swapColor);
   y += s;
 
-  uint16_t diskColor = (stats.disk_p > 90) ? COLOR_WARN : COLOR_TEXT;
-  drawLine(y, "DISK", String((int)stats.disk_p) + "%", diskColor);
+  uint16_t diskColor = alertColor(LINE_DISK);
+  drawAnomalyMark(y, LINE_DISK);
+  drawLine(y, "DISK", String((int)metric[M_DISK_P]) + "%", diskColor);
+
+  if (anomaly.count > 0) {
+    spr.setTextDatum(MC_DATUM);
+    spr.setTextColor(COLOR_WARN, COLOR_BG);
+    String note = String(anomaly.text);
+    if (anomaly.count > 1)
+      note += " +" + String(anomaly.count - 1);
+    spr.drawString(note, SCREEN_W / 2, SCREEN_H - 26, 2);
+  }
 
   spr.setTextDatum(MC_DATUM);
   spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
   spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
                  2);
 
-  spr.pushSprite(0, 0);
+  pushScreen();
 }
 
 uint16_t heatColor(float load) {
@@ -179,11 +414,15 @@ void drawReactorScreen() {
       int x = startX + col * (cellW + gap);
       int y = startY + row * (cellH + gap);
 
-      float load = (idx < stats.core_count) ? stats.cores[idx] : 0;
+      float load = (idx < coreCount) ? metric[M_CPU_CORES_0 + idx] : 0;
       uint16_t color = heatColor(load);
 
       spr.fillRect(x, y, cellW, cellH, color);
       spr.drawRect(x, y, cellW, cellH, COLOR_BG);
+      if (anomaly.cores & (1 << idx)) {
+        spr.drawRect(x + 1, y + 1, cellW - 2, cellH - 2, COLOR_WARN);
+        spr.drawRect(x + 2, y + 2, cellW - 4, cellH - 4, COLOR_BG);
+      }
 
       spr.setTextDatum(MC_DATUM);
       spr.setTextColor(COLOR_BG, color);
@@ -199,17 +438,17 @@ void drawReactorScreen() {
   int boxW = 90;
   int boxH = 35;
 
-  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(stats.gpu_load));
+  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(metric[M_GPU_GPU_LOAD]));
   spr.drawRect(boxX, boxY, boxW, boxH, COLOR_BG);
   spr.setTextDatum(MC_DATUM);
   spr.setTextColor(COLOR_BG);
   spr.drawString("GPU", boxX + boxW / 2, boxY + 10, 2);
-  spr.drawString(String(stats.gpu_load) + "%", boxX + boxW / 2, boxY + 24, 1);
+  spr.drawString(String((int)metric[M_GPU_GPU_LOAD]) + "%", boxX + boxW / 2, boxY + 24, 1);
 
   boxY += boxH + gap;
 
   float vramP =
-      (stats.vram_total > 0) ? (stats.vram_used / stats.vram_total * 100) : 0;
+      (metric[M_GPU_VRAM_TOTAL] > 0) ? (metric[M_GPU_VRAM_USED] / metric[M_GPU_VRAM_TOTAL] * 100) : 0;
   spr.fillRect(boxX, boxY, boxW, boxH, heatColor(vramP));
   spr.drawRect(boxX, boxY, boxW, boxH, COLOR_BG);
   spr.setTextColor(COLOR_BG);
@@ -218,19 +457,19 @@ void drawReactorScreen() {
 
   boxY += boxH + gap;
 
-  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(stats.ram_p));
+  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(metric[M_RAM_P]));
   spr.drawRect(boxX, boxY, boxW, boxH, COLOR_BG);
   spr.setTextColor(COLOR_BG);
   spr.drawString("RAM", boxX + boxW / 2, boxY + 10, 2);
-  spr.drawString(String((int)stats.ram_p) + "%", boxX + boxW / 2, boxY + 24, 1);
+  spr.drawString(String((int)metric[M_RAM_P]) + "%", boxX + boxW / 2, boxY + 24, 1);
 
   boxY += boxH + gap;
 
-  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(stats.swap_p));
+  spr.fillRect(boxX, boxY, boxW, boxH, heatColor(metric[M_SWAP_P]));
   spr.drawRect(boxX, boxY, boxW, boxH, COLOR_BG);
   spr.setTextColor(COLOR_BG);
   spr.drawString("SWAP", boxX + boxW / 2, boxY + 10, 2);
-  spr.drawString(String((int)stats.swap_p) + "%", boxX + boxW / 2, boxY + 24,
+  spr.drawString(String((int)metric[M_SWAP_P]) + "%", boxX + boxW / 2, boxY + 24,
                  1);
 
   int infoY = startY + 4 * (cellH + gap) + 5;
@@ -238,32 +477,801 @@ void drawReactorScreen() {
   spr.setTextColor(COLOR_DIM, COLOR_BG);
   spr.drawString("CPU", 5, infoY, 1);
   spr.setTextColor(COLOR_TEXT, COLOR_BG);
-  spr.drawString(String((int)stats.cpu_temp) + "C", 27, infoY, 1);
-  spr.drawString(String((int)stats.cpu_pwr) + "W", 52, infoY, 1);
+  spr.drawString(String((int)metric[M_CPU_TEMP]) + "C", 27, infoY, 1);
+  spr.drawString(String((int)metric[M_CPU_PWR]) + "W", 52, infoY, 1);
   spr.setTextColor(COLOR_DIM, COLOR_BG);
-  spr.drawString(String(stats.cpu_fan) + "r", 79, infoY, 1);
+  spr.drawString(String((int)metric[M_CPU_FAN]) + "r", 79, infoY, 1);
 
   spr.setTextColor(COLOR_DIM, COLOR_BG);
   spr.drawString("GPU", 130, infoY, 1);
   spr.setTextColor(COLOR_TEXT, COLOR_BG);
-  spr.drawString(String(stats.gpu_temp) + "C", 152, infoY, 1);
-  spr.drawString(String((int)stats.gpu_pwr) + "W", 177, infoY, 1);
+  spr.drawString(String((int)metric[M_GPU_GPU_TEMP]) + "C", 152, infoY, 1);
+  spr.drawString(String((int)metric[M_GPU_GPU_PWR]) + "W", 177, infoY, 1);
   spr.setTextColor(COLOR_DIM, COLOR_BG);
-  spr.drawString(String(stats.gpu_fan) + "%", 207, infoY, 1);
+  spr.drawString(String((int)metric[M_GPU_GPU_FAN]) + "%", 207, infoY, 1);
 
   spr.setTextDatum(MC_DATUM);
   spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
   spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 5,
                  1);
 
-  spr.pushSprite(0, 0);
+  pushScreen();
+}
+
+void drawClusterScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("CLUSTER", SCREEN_W / 2, 8, 2);
+
+  if (hostCount == 0) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO AGENTS", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    int y = 28;
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.setTextDatum(TL_DATUM);
+    spr.drawString("HOST", 10, y, 2);
+    spr.setTextDatum(TR_DATUM);
+    spr.drawString("CPU", 150, y, 2);
+    spr.drawString("TEMP", 200, y, 2);
+    spr.drawString("RAM", 255, y, 2);
+    spr.drawString("GPU", 310, y, 2);
+    y += 20;
+
+    for (int i = 0; i < hostCount; i++) {
+      const HostSummary &h = hosts[i];
+      uint16_t color = h.stale ? COLOR_DIM : COLOR_TEXT;
+      spr.setTextDatum(TL_DATUM);
+      spr.setTextColor(color, COLOR_BG);
+      spr.drawString(h.name, 10, y, 2);
+      spr.setTextDatum(TR_DATUM);
+      if (h.stale) {
+        spr.drawString("STALE", 310, y, 2);
+      } else {
+        spr.setTextColor((h.cpu_load > 80) ? COLOR_WARN : COLOR_TEXT, COLOR_BG);
+        spr.drawString(String((int)h.cpu_load) + "%", 150, y, 2);
+        spr.setTextColor(COLOR_TEXT, COLOR_BG);
+        spr.drawString(String((int)h.cpu_temp) + "C", 200, y, 2);
+        spr.drawString(String((int)h.ram_p) + "%", 255, y, 2);
+        spr.drawString(String((int)h.gpu_load) + "%", 310, y, 2);
+      }
+      y += 20;
+    }
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  String footer = isConnected ? "ONLINE" : "OFFLINE";
+  if (hostTotal > 0) {
+    footer += "  " + String(hostTotal) + " HOSTS";
+    if (hostStale > 0)
+      footer += " / " + String(hostStale) + " STALE";
+  }
+  spr.drawString(footer, SCREEN_W / 2, SCREEN_H - 8, 2);
+
+  pushScreen();
+}
+
+void drawAppScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("APPLICATION", SCREEN_W / 2, 8, 2);
+
+  if (customCount == 0) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO APP METRICS", SCREEN_W / 2, SCREEN_H / 2, 2);
+  }
+
+  int tileW = 150;
+  int tileH = 95;
+  for (int i = 0; i < customCount; i++) {
+    int x = 7 + (i % 2) * (tileW + 6);
+    int y = 24 + (i / 2) * (tileH + 6);
+    spr.drawRect(x, y, tileW, tileH, COLOR_DIM);
+    spr.setTextDatum(MC_DATUM);
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString(custom[i].name, x + tileW / 2, y + 16, 2);
+    if (custom[i].down) {
+      spr.drawRect(x, y, tileW, tileH, COLOR_WARN);
+      spr.setTextColor(COLOR_WARN, COLOR_BG);
+      spr.drawString("DOWN", x + tileW / 2, y + tileH / 2 + 10, 4);
+      continue;
+    }
+    spr.setTextColor(custom[i].valid ? COLOR_BRIGHT : COLOR_DIM, COLOR_BG);
+    spr.drawString(custom[i].valid ? formatValue(custom[i].value) : String("--"),
+                   x + tileW / 2, y + tileH / 2 + 10, 4);
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+void drawWatchScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("WATCH", SCREEN_W / 2, 8, 2);
+
+  if (!watch.present) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NOT WATCHING", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    String title = String(watch.name);
+    if (watch.up)
+      title += " [" + String(watch.pid) + "]";
+    spr.setTextColor(watch.up ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+    spr.drawString(watch.up ? title : title + " DOWN", SCREEN_W / 2, 28, 2);
+
+    int y = 46;
+    int s = 17;
+    uint16_t cpuColor = (watch.cpu > 80) ? COLOR_WARN : COLOR_TEXT;
+    drawLine(y, "CPU",
+             String(watch.cpu, 1) + "% pk " + String(watch.cpu_peak, 1) + "%",
+             cpuColor);
+    y += s;
+    drawLine(y, "RSS", String(watch.rss, 1) + "MB", COLOR_TEXT);
+    y += s;
+    drawLine(y, "THR/FD",
+             String(watch.threads) + " / " + String(watch.fds), COLOR_TEXT);
+    y += s;
+    drawLine(y, "CTX", String((int)watch.ctx_switches) + "/s", COLOR_TEXT);
+    y += s;
+    drawLine(y, "IO R/W",
+             formatValue(watch.io_read) + " / " + formatValue(watch.io_write) +
+                 "KB/s",
+             COLOR_TEXT);
+    y += s + 4;
+
+    // Busiest threads as bars, 100% of one core = full width
+    for (int i = 0; i < watch.top_count; i++) {
+      int barW = constrain((int)(watch.top_cpu[i] * 1.6), 0, 160);
+      spr.fillRect(140, y + 3, barW, 10, heatColor(watch.top_cpu[i]));
+      spr.setTextDatum(TL_DATUM);
+      spr.setTextColor(COLOR_DIM, COLOR_BG);
+      spr.drawString(watch.top_name[i], 10, y, 2);
+      spr.setTextDatum(TR_DATUM);
+      spr.setTextColor(COLOR_TEXT, COLOR_BG);
+      spr.drawString(String((int)watch.top_cpu[i]) + "%", 135, y, 2);
+      y += s;
+    }
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  String footer = isConnected ? "ONLINE" : "OFFLINE";
+  if (watch.restarts > 0)
+    footer += "  " + String(watch.restarts) + " RESTARTS";
+  spr.drawString(footer, SCREEN_W / 2, SCREEN_H - 8, 2);
+
+  pushScreen();
+}
+
+String perSecond(float v) { return formatValue(v) + "/s"; }
+
+void drawNetScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("NETWORK HEALTH", SCREEN_W / 2, 8, 2);
+
+  if (!proto.present) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO PROTOCOL STATS", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    // Any loss-type counter moving at all is worth a look
+    int y = 28;
+    int s = 18;
+    drawLine(y, "TCP RETRANS",
+             perSecond(proto.retrans) + " (" + String(proto.retransPct, 2) + "%)",
+             proto.retransPct > 1 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "RTO TIMEOUTS", perSecond(proto.timeouts),
+             proto.timeouts > 0 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "LISTEN OVF/DROP",
+             formatValue(proto.listenOverflows) + " / " + perSecond(proto.listenDrops),
+             proto.listenOverflows + proto.listenDrops > 0 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "RESETS", perSecond(proto.resets), COLOR_TEXT);
+    y += s;
+    drawLine(y, "CONNECT FAILS", perSecond(proto.attemptFails), COLOR_TEXT);
+    y += s;
+    drawLine(y, "TCP IN ERRS", perSecond(proto.tcpInErrs),
+             proto.tcpInErrs > 0 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "ESTABLISHED", String(proto.established), COLOR_TEXT);
+    y += s + 6;
+    drawLine(y, "UDP RCVBUF ERR", perSecond(proto.udpRcvbuf),
+             proto.udpRcvbuf > 0 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "UDP IN ERRS", perSecond(proto.udpInErrs),
+             proto.udpInErrs > 0 ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "UDP NO PORT", perSecond(proto.udpNoPorts), COLOR_TEXT);
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+String formatHours(float h) {
+  if (h < 0)
+    return "-";
+  if (h < 48)
+    return String(h, 1) + "h";
+  return String((int)(h / 24)) + "d";
+}
+
+void drawFsScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("FILESYSTEMS", SCREEN_W / 2, 8, 2);
+
+  if (fsCount == 0) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO FILESYSTEMS", SCREEN_W / 2, SCREEN_H / 2, 2);
+  }
+
+  int y = 26;
+  for (int i = 0; i < fsCount; i++) {
+    FsRow &f = fsRows[i];
+    // Filling within a day is as urgent as being nearly full
+    bool urgent = f.pct > 90 || f.inodePct > 90 ||
+                  (f.hoursToFull >= 0 && f.hoursToFull < 24);
+    spr.setTextDatum(TL_DATUM);
+    spr.setTextColor(f.stale ? COLOR_WARN : COLOR_TEXT, COLOR_BG);
+    spr.drawString(f.stale ? String(f.mount) + " STALE" : String(f.mount), 10, y, 2);
+    spr.setTextDatum(TR_DATUM);
+    spr.setTextColor(urgent ? COLOR_WARN : COLOR_BRIGHT, COLOR_BG);
+    spr.drawString(formatValue(f.usedGb) + "/" + formatValue(f.totalGb) + "G " +
+                       String((int)f.pct) + "%",
+                   310, y, 2);
+
+    int barW = constrain((int)(f.pct * 1.5), 0, 150);
+    spr.drawRect(10, y + 20, 152, 10, COLOR_DIM);
+    spr.fillRect(11, y + 21, barW, 8, heatColor(f.pct));
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("INO " + String((int)f.inodePct) + "%  FULL " +
+                       formatHours(f.hoursToFull),
+                   310, y + 18, 2);
+    y += 40;
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+void drawEnergyScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("ENERGY", SCREEN_W / 2, 8, 2);
+
+  if (energyCount == 0) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO ENERGY DATA", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.setTextDatum(TL_DATUM);
+    spr.drawString("DOMAIN", 10, 26, 2);
+    spr.setTextDatum(TR_DATUM);
+    spr.drawString("W", 140, 26, 2);
+    spr.drawString("WH 1H", 225, 26, 2);
+    spr.drawString("WH 24H", 310, 26, 2);
+
+    int y = 46;
+    for (int i = 0; i < energyCount; i++) {
+      EnergyRow &e = energyRows[i];
+      spr.setTextDatum(TL_DATUM);
+      spr.setTextColor(COLOR_TEXT, COLOR_BG);
+      spr.drawString(e.name, 10, y, 2);
+      spr.setTextDatum(TR_DATUM);
+      spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+      spr.drawString(String(e.watts, 1), 140, y, 2);
+      spr.drawString(formatValue(e.whHour), 225, y, 2);
+      spr.drawString(formatValue(e.whDay), 310, y, 2);
+      y += 20;
+    }
+
+    spr.drawFastHLine(10, y + 4, 300, COLOR_DIM);
+    drawLine(y + 12, "LAST HOUR", formatValue(energyHour) + " Wh", COLOR_BRIGHT);
+    drawLine(y + 32, "LAST DAY", formatValue(energyDay) + " Wh", COLOR_BRIGHT);
+    drawLine(y + 52, "LIFETIME", String(energyKwh, 2) + " kWh", COLOR_TEXT);
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+void drawDebugScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("DEBUG", SCREEN_W / 2, 8, 2);
+
+  int y = 30;
+  int s = 20;
+  if (monitorCost.present) {
+    bool over = monitorCost.budget > 0 && monitorCost.cpu > monitorCost.budget;
+    String cpu = String(monitorCost.cpu, 2) + "%";
+    if (monitorCost.budget > 0)
+      cpu += " / " + String(monitorCost.budget, 2) + "%";
+    drawLine(y, "HOST CPU", cpu, over ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+    drawLine(y, "HOST TICK", String(monitorCost.tick_us) + "us", COLOR_TEXT);
+    y += s;
+    drawLine(y, "HOST RSS", String(monitorCost.rss, 1) + "MB", COLOR_TEXT);
+    y += s;
+    drawLine(y, "THROTTLED", monitorCost.throttled[0] ? String(monitorCost.throttled) : "-",
+             monitorCost.throttled[0] ? COLOR_WARN : COLOR_TEXT);
+    y += s;
+  } else {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO HOST STATS", SCREEN_W / 2, y + 30, 2);
+    y += 4 * s;
+  }
+
+  y += 6;
+  if (latency.total[0] >= 0) {
+    drawLine(y, "AGE P50/P99",
+             String(latency.total[0], 1) + " / " + String(latency.total[1], 1) + "ms",
+             COLOR_TEXT);
+    y += s;
+  }
+  if (latency.host[0] >= 0) {
+    drawLine(y, "HOST/UART P99",
+             String(latency.host[1], 1) + " / " +
+                 (latency.uart[1] >= 0 ? String(latency.uart[1], 1) : String("-")) + "ms",
+             COLOR_TEXT);
+    y += s;
+    drawLine(y, "PRS/DRW/PSH P99",
+             String(latency.parse[1], 1) + "/" + String(latency.draw[1], 1) + "/" +
+                 String(latency.push[1], 1),
+             COLOR_TEXT);
+  } else {
+    drawLine(y, "DRAW/PUSH",
+             String(frameTrace.drawDur / 1000.0, 1) + " / " +
+                 String(frameTrace.pushDur / 1000.0, 1) + "ms",
+             COLOR_TEXT);
+  }
+  y += s;
+  drawLine(y, "FREE HEAP",
+           String(ESP.getFreeHeap() / 1024) + " / min " +
+               String(ESP.getMinFreeHeap() / 1024) + "KB",
+           COLOR_TEXT);
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+// Registered metrics arrive either as one "v" array indexed by MetricId
+// (host --protocol ids) or as the nested cpu/ram/swap/gpu/disk/net objects
+void parseMetrics(JsonDocument &doc) {
+  JsonArray v = doc["v"];
+  if (!v.isNull()) {
+    // Another registry's IDs would land on the wrong metrics
+    if ((doc["rv"] | 0UL) != METRIC_REGISTRY_VERSION)
+      return;
+    int n = min((int)v.size(), (int)METRIC_COUNT);
+    coreCount = 0;
+    for (int i = 0; i < n; i++) {
+      bool present = !v[i].isNull();
+      metric[i] = present ? v[i].as<float>() / METRIC_SCALE[i] : 0;
+      if (present && i >= M_CPU_CORES_0 && i < M_CPU_CORES_0 + METRIC_MAX_CORES)
+        coreCount = i - M_CPU_CORES_0 + 1;
+    }
+    return;
+  }
+
+  JsonObject cpu = doc["cpu"];
+  metric[M_CPU_LOAD] = cpu["load"];
+  metric[M_CPU_TEMP] = cpu["temp"];
+  metric[M_CPU_FREQ] = cpu["freq"];
+  metric[M_CPU_PWR] = cpu["pwr"];
+  metric[M_CPU_FAN] = cpu["fan"];
+
+  JsonArray cores = cpu["cores"];
+  coreCount = min((int)cores.size(), METRIC_MAX_CORES);
+  for (int i = 0; i < coreCount; i++) {
+    metric[M_CPU_CORES_0 + i] = cores[i];
+  }
+
+  metric[M_RAM_USED] = doc["ram"]["used"];
+  metric[M_RAM_TOTAL] = doc["ram"]["total"];
+  metric[M_RAM_P] = doc["ram"]["p"];
+
+  metric[M_SWAP_USED] = doc["swap"]["used"];
+  metric[M_SWAP_P] = doc["swap"]["p"];
+
+  JsonObject gpu = doc["gpu"];
+  metric[M_GPU_GPU_LOAD] = gpu["gpu_load"];
+  metric[M_GPU_VRAM_USED] = gpu["vram_used"];
+  metric[M_GPU_VRAM_TOTAL] = gpu["vram_total"];
+  metric[M_GPU_VRAM_P] = gpu["vram_p"];
+  metric[M_GPU_GPU_TEMP] = gpu["gpu_temp"];
+  metric[M_GPU_GPU_PWR] = gpu["gpu_pwr"];
+  metric[M_GPU_GPU_FAN] = gpu["gpu_fan"];
+
+  metric[M_DISK_P] = doc["disk"]["p"];
+  metric[M_NET_SENT] = doc["net"]["sent"];
+  metric[M_NET_RECV] = doc["net"]["recv"];
+}
+
+void parseStats(JsonDocument &doc) {
+  parseMetrics(doc);
+
+  JsonArray hostArr = doc["hosts"];
+  if (!hostArr.isNull()) {
+    hostCount = min((int)hostArr.size(), MAX_HOSTS);
+    for (int i = 0; i < hostCount; i++) {
+      JsonObject h = hostArr[i];
+      strlcpy(hosts[i].name, h["n"] | "?", sizeof(hosts[i].name));
+      hosts[i].cpu_load = h["c"];
+      hosts[i].cpu_temp = h["t"];
+      hosts[i].ram_p = h["r"];
+      hosts[i].gpu_load = h["g"];
+      hosts[i].stale = h["s"];
+    }
+    hostTotal = doc["hn"];
+    hostStale = doc["hs"];
+  }
+
+  JsonArray customArr = doc["custom"];
+  if (!customArr.isNull()) {
+    customCount = min((int)customArr.size(), MAX_CUSTOM);
+    for (int i = 0; i < customCount; i++) {
+      JsonObject c = customArr[i];
+      strlcpy(custom[i].name, c["n"] | "?", sizeof(custom[i].name));
+      custom[i].valid = !c["v"].isNull();
+      custom[i].value = c["v"] | 0.0f;
+      custom[i].down = c["d"] | 0;
+    }
+  }
+
+  JsonObject w = doc["watch"];
+  watch.present = !w.isNull();
+  if (watch.present) {
+    strlcpy(watch.name, w["n"] | "?", sizeof(watch.name));
+    watch.up = w["up"];
+    watch.pid = w["pid"];
+    watch.restarts = w["rs"];
+    watch.cpu = w["cpu"];
+    watch.cpu_peak = w["pk"];
+    watch.rss = w["rss"];
+    watch.fds = w["fds"];
+    watch.threads = w["thr"];
+    watch.ctx_switches = w["cs"];
+    watch.io_read = w["rd"];
+    watch.io_write = w["wr"];
+    JsonArray top = w["top"];
+    watch.top_count = min((int)top.size(), MAX_TOP_THREADS);
+    for (int i = 0; i < watch.top_count; i++) {
+      strlcpy(watch.top_name[i], top[i][0] | "?", sizeof(watch.top_name[i]));
+      watch.top_cpu[i] = top[i][1];
+    }
+  }
+
+  JsonObject pr = doc["proto"];
+  proto.present = !pr.isNull();
+  if (proto.present) {
+    proto.retrans = pr["retr"];
+    proto.retransPct = pr["retr_p"];
+    proto.timeouts = pr["tmo"];
+    proto.listenOverflows = pr["lovf"];
+    proto.listenDrops = pr["ldrop"];
+    proto.resets = pr["rst"];
+    proto.attemptFails = pr["afail"];
+    proto.tcpInErrs = pr["inerr"];
+    proto.udpInErrs = pr["uerr"];
+    proto.udpRcvbuf = pr["ubuf"];
+    proto.udpNoPorts = pr["noport"];
+    proto.established = pr["estab"];
+  }
+
+  JsonArray fsArr = doc["fs"];
+  if (!fsArr.isNull()) {
+    fsCount = min((int)fsArr.size(), MAX_FS_ROWS);
+    for (int i = 0; i < fsCount; i++) {
+      JsonObject f = fsArr[i];
+      strlcpy(fsRows[i].mount, f["m"] | "?", sizeof(fsRows[i].mount));
+      fsRows[i].pct = f["p"];
+      fsRows[i].inodePct = f["ip"];
+      fsRows[i].usedGb = f["u"];
+      fsRows[i].totalGb = f["t"];
+      fsRows[i].hoursToFull = f["ttf"] | -1.0f;
+      fsRows[i].stale = f["st"] | 0;
+    }
+  }
+
+  JsonObject en = doc["en"];
+  if (!en.isNull()) {
+    JsonArray rows = en["d"];
+    energyCount = min((int)rows.size(), MAX_ENERGY_ROWS);
+    for (int i = 0; i < energyCount; i++) {
+      JsonArray r = rows[i];
+      strlcpy(energyRows[i].name, r[0] | "?", sizeof(energyRows[i].name));
+      energyRows[i].watts = r[1];
+      energyRows[i].whHour = r[2];
+      energyRows[i].whDay = r[3];
+    }
+    energyHour = en["h"];
+    energyDay = en["day"];
+    energyKwh = en["kwh"];
+  }
+
+  JsonArray tailArr = doc["tails"];
+  if (!tailArr.isNull()) {
+    tailCount = min((int)tailArr.size(), MAX_TAIL_ROWS);
+    for (int i = 0; i < tailCount; i++) {
+      JsonObject t = tailArr[i];
+      strlcpy(tails[i].name, t["n"] | "?", sizeof(tails[i].name));
+      tails[i].window = t["w"];
+      tails[i].p50 = t["p"][0];
+      tails[i].p95 = t["p"][1];
+      tails[i].p99 = t["p"][2];
+    }
+  }
+
+  JsonObject an = doc["anom"];
+  anomaly.lines = an["l"] | 0;
+  anomaly.cores = an["c"] | 0;
+  anomaly.count = an["n"] | 0;
+  strlcpy(anomaly.text, an["txt"] | "", sizeof(anomaly.text));
+
+  JsonObject me = doc["self"];
+  monitorCost.present = !me.isNull();
+  if (monitorCost.present) {
+    monitorCost.cpu = me["cpu"];
+    monitorCost.budget = me["bud"];
+    monitorCost.tick_us = me["us"];
+    monitorCost.rss = me["rss"];
+    strlcpy(monitorCost.throttled, me["thr"] | "", sizeof(monitorCost.throttled));
+  }
+
+  JsonObject lat = doc["lat"];
+  float *stages[] = {latency.total, latency.host, latency.uart,
+                     latency.parse, latency.draw, latency.push};
+  const char *keys[] = {"total", "host", "uart", "parse", "draw", "push"};
+  for (int i = 0; i < 6; i++) {
+    JsonArray p = lat[keys[i]];
+    stages[i][0] = p.isNull() ? -1 : p[0].as<float>();
+    stages[i][1] = p.isNull() ? -1 : p[1].as<float>();
+  }
+
+  JsonObject al = doc["al"];
+  alerts.warn = al["w"] | 0;
+  alerts.crit = al["c"] | 0;
+  alerts.count = al["n"] | 0;
+}
+
+void parseAlert(JsonDocument &doc) {
+  strlcpy(alerts.name, doc["n"] | "?", sizeof(alerts.name));
+  alerts.on = doc["on"] | 0;
+  alerts.critical = doc["crit"] | 0;
+  alerts.value = doc["v"] | 0.0f;
+  alerts.changedAt = millis();
+  if (alerts.changedAt == 0)
+    alerts.changedAt = 1;
+}
+
+// Pre-aggregated history series sent by the host every few seconds.
+// One byte per column scaled to [lo, hi]; 0xFF marks a column without data.
+#define HIST_POINTS 150
+#define HIST_NONE 0xFF
+
+struct History {
+  bool valid = false;
+  char name[24] = "";
+  int span = 0;
+  float lo = 0;
+  float hi = 0;
+  uint8_t mn[HIST_POINTS];
+  uint8_t mx[HIST_POINTS];
+  uint8_t av[HIST_POINTS];
+};
+History hist;
+
+uint8_t hexByte(const char *p) {
+  uint8_t v = 0;
+  for (int i = 0; i < 2; i++) {
+    char c = p[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9')
+      v |= c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v |= c - 'A' + 10;
+  }
+  return v;
+}
+
+void decodeHistory(const char *hex, uint8_t *out) {
+  size_t len = hex ? strlen(hex) / 2 : 0;
+  for (int i = 0; i < HIST_POINTS; i++)
+    out[i] = (i < (int)len) ? hexByte(hex + i * 2) : HIST_NONE;
+}
+
+void parseHistory(JsonDocument &doc) {
+  strlcpy(hist.name, doc["n"] | "?", sizeof(hist.name));
+  hist.span = doc["span"];
+  hist.lo = doc["lo"];
+  hist.hi = doc["hi"];
+  decodeHistory(doc["mn"], hist.mn);
+  decodeHistory(doc["mx"], hist.mx);
+  decodeHistory(doc["av"], hist.av);
+  hist.valid = true;
+}
+
+void drawHistoryScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("HISTORY", SCREEN_W / 2, 8, 2);
+
+  if (!hist.valid) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO HISTORY (--store)", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    int gx = 10;
+    int gy = 30;
+    int gw = HIST_POINTS * 2;
+    int gh = 170;
+    spr.drawRect(gx - 1, gy - 1, gw + 2, gh + 2, COLOR_DIM);
+
+    for (int i = 0; i < HIST_POINTS; i++) {
+      if (hist.mn[i] == HIST_NONE)
+        continue;
+      int x = gx + i * 2;
+      int yMax = gy + gh - 1 - hist.mx[i] * (gh - 1) / 254;
+      int yMin = gy + gh - 1 - hist.mn[i] * (gh - 1) / 254;
+      int yAvg = gy + gh - 1 - hist.av[i] * (gh - 1) / 254;
+      // Min/max band with the average drawn on top
+      spr.fillRect(x, yMax, 2, yMin - yMax + 1, COLOR_DIM);
+      spr.fillRect(x, yAvg, 2, 2, COLOR_BRIGHT);
+    }
+
+    spr.setTextDatum(TL_DATUM);
+    spr.setTextColor(COLOR_TEXT, COLOR_BG);
+    spr.drawString(String(hist.hi, 0), gx + 2, gy + 2, 1);
+    spr.setTextDatum(BL_DATUM);
+    spr.drawString(String(hist.lo, 0), gx + 2, gy + gh - 2, 1);
+
+    spr.setTextDatum(TL_DATUM);
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString(hist.name, gx, gy + gh + 4, 2);
+    spr.setTextDatum(TR_DATUM);
+    spr.drawString("-" + String(hist.span / 60) + "m .. now", gx + gw, gy + gh + 4, 2);
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+void drawTailsScreen() {
+  spr.fillScreen(COLOR_BG);
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+  spr.drawString("TAILS", SCREEN_W / 2, 8, 2);
+
+  if (tailCount == 0) {
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.drawString("NO PERCENTILES (--tails)", SCREEN_W / 2, SCREEN_H / 2, 2);
+  } else {
+    int y = 30;
+    spr.setTextColor(COLOR_DIM, COLOR_BG);
+    spr.setTextDatum(TL_DATUM);
+    spr.drawString("METRIC", 10, y, 2);
+    spr.setTextDatum(TR_DATUM);
+    spr.drawString("WIN", 135, y, 2);
+    spr.drawString("P50", 190, y, 2);
+    spr.drawString("P95", 250, y, 2);
+    spr.drawString("P99", 310, y, 2);
+    y += 26;
+
+    for (int i = 0; i < tailCount; i++) {
+      const TailRow &t = tails[i];
+      spr.setTextDatum(TL_DATUM);
+      spr.setTextColor(COLOR_TEXT, COLOR_BG);
+      spr.drawString(t.name, 10, y, 2);
+      spr.setTextDatum(TR_DATUM);
+      spr.setTextColor(COLOR_DIM, COLOR_BG);
+      spr.drawString(String(t.window / 60) + "m", 135, y, 2);
+      spr.setTextColor(COLOR_TEXT, COLOR_BG);
+      spr.drawString(formatValue(t.p50), 190, y, 2);
+      spr.drawString(formatValue(t.p95), 250, y, 2);
+      spr.setTextColor(COLOR_BRIGHT, COLOR_BG);
+      spr.drawString(formatValue(t.p99), 310, y, 2);
+      y += 26;
+    }
+  }
+
+  spr.setTextDatum(MC_DATUM);
+  spr.setTextColor(isConnected ? COLOR_TEXT : COLOR_WARN, COLOR_BG);
+  spr.drawString(isConnected ? "ONLINE" : "OFFLINE", SCREEN_W / 2, SCREEN_H - 8,
+                 2);
+
+  pushScreen();
+}
+
+void addSpan(JsonDocument &out, const char *key, uint32_t start,
+             uint32_t dur) {
+  JsonArray span = out.createNestedArray(key);
+  span.add(start);
+  span.add(dur);
+}
+
+void sendTrace() {
+  StaticJsonDocument<256> out;
+  out["t"] = "tr";
+  out["id"] = frameTrace.id;
+  addSpan(out, "rx", frameTrace.rx, frameTrace.rxDur);
+  addSpan(out, "ps", frameTrace.parse, frameTrace.parseDur);
+  addSpan(out, "dr", frameTrace.draw, frameTrace.drawDur);
+  addSpan(out, "pu", frameTrace.push, frameTrace.pushDur);
+  serializeJson(out, Serial);
+  Serial.println();
+}
+
+// Clock alignment for host traces: echo the host stamp with our own
+void sendPong(JsonDocument &doc) {
+  StaticJsonDocument<96> out;
+  out["t"] = "pong";
+  out["h"] = doc["h"];
+  out["d"] = micros();
+  serializeJson(out, Serial);
+  Serial.println();
+}
+
+// Acknowledge at the old rate, then switch once the ack is on the wire
+void switchBaud(JsonDocument &doc) {
+  uint32_t baud = doc["v"] | 0UL;
+  if (baud < 9600 || baud > 2000000)
+    return;
+  StaticJsonDocument<64> out;
+  out["t"] = "baud";
+  out["v"] = baud;
+  serializeJson(out, Serial);
+  Serial.println();
+  Serial.flush();
+  fallbackBaud = linkBaud;
+  linkBaud = baud;
+  baudSwitchedAt = millis();
+  Serial.updateBaudRate(baud);
 }
 
 void loop() {
   static bool lastBtn = HIGH;
   bool btn = digitalRead(0);
   if (btn == LOW && lastBtn == HIGH) {
-    currentMode = (currentMode == MODE_STATS) ? MODE_REACTOR : MODE_STATS;
+    currentMode = (Mode)((currentMode + 1) % MODE_COUNT);
     modeChanged = true;
     delay(300);
   }
@@ -283,53 +1291,59 @@ void loop() {
         modeChanged = true;
         delay(300);
       }
+    } else {
+      // Middle of the screen steps through the remaining pages
+      currentMode = (Mode)((currentMode + 1) % MODE_COUNT);
+      modeChanged = true;
+      delay(300);
     }
   }
 
   bool dataUpdated = false;
 
   if (Serial.available()) {
+    uint32_t rxStart = micros();
     String line = Serial.readStringUntil('\n');
-    StaticJsonDocument<1536> doc; // Increased size to be safe
+    uint32_t parseStart = micros();
+    // Static so the larger document does not live on the loop task stack
+    static StaticJsonDocument<4096> doc;
     DeserializationError error = deserializeJson(doc, line);
 
     if (!error) {
       lastDataTime = millis();
       isConnected = true;
-      dataUpdated = true;
-
-      stats.cpu_load = doc["cpu"]["load"];
-      stats.cpu_temp = doc["cpu"]["temp"];
-      stats.cpu_freq = doc["cpu"]["freq"];
-      stats.cpu_pwr = doc["cpu"]["pwr"];
-      stats.cpu_fan = doc["cpu"]["fan"];
-
-      JsonArray cores = doc["cpu"]["cores"];
-      stats.core_count = min((int)cores.size(), 16);
-      for (int i = 0; i < stats.core_count; i++) {
-        stats.cores[i] = cores[i];
-      }
-
-      stats.ram_used = doc["ram"]["used"];
-      stats.ram_total = doc["ram"]["total"];
-      stats.ram_p = doc["ram"]["p"];
-
-      stats.swap_used = doc["swap"]["used"];
-      stats.swap_p = doc["swap"]["p"];
 
-      stats.gpu_load = doc["gpu"]["gpu_load"];
-      stats.vram_used = doc["gpu"]["vram_used"];
-      stats.vram_total = doc["gpu"]["vram_total"];
-      stats.gpu_temp = doc["gpu"]["gpu_temp"];
-      stats.gpu_pwr = doc["gpu"]["gpu_pwr"];
-      stats.gpu_fan = doc["gpu"]["gpu_fan"];
-
-      stats.disk_p = doc["disk"]["p"];
-      stats.net_sent = doc["net"]["sent"];
-      stats.net_recv = doc["net"]["recv"];
+      const char *type = doc["t"] | "s";
+      // Anything parsed after a switch proves the new rate works
+      fallbackBaud = 0;
+      if (strcmp(type, "baud") == 0) {
+        switchBaud(doc);
+      } else if (strcmp(type, "ping") == 0) {
+        sendPong(doc);
+      } else if (strcmp(type, "hist") == 0) {
+        parseHistory(doc);
+        dataUpdated = true;
+      } else if (strcmp(type, "alert") == 0) {
+        parseAlert(doc);
+        dataUpdated = true;
+      } else {
+        parseStats(doc);
+        dataUpdated = true;
+        frameTrace.id = doc["id"] | 0L;
+        frameTrace.rx = rxStart;
+        frameTrace.rxDur = parseStart - rxStart;
+        frameTrace.parse = parseStart;
+        frameTrace.parseDur = micros() - parseStart;
+      }
     }
   }
 
+  if (fallbackBaud && millis() - baudSwitchedAt > BAUD_CONFIRM_MS) {
+    linkBaud = fallbackBaud;
+    fallbackBaud = 0;
+    Serial.updateBaudRate(linkBaud);
+  }
+
   if (millis() - lastDataTime > 3000) {
     if (isConnected) { // State changed to offline
       isConnected = false;
@@ -340,11 +1354,49 @@ void loop() {
   // Only redraw if data changed, mode changed, or periodically (to keep alive)
   static unsigned long lastDrawTime = 0;
   if (dataUpdated || modeChanged || (millis() - lastDrawTime > 200)) {
-    if (currentMode == MODE_STATS) {
+    uint32_t drawStart = micros();
+    switch (currentMode) {
+    case MODE_STATS:
       drawStatsScreen();
-    } else {
+      break;
+    case MODE_CLUSTER:
+      drawClusterScreen();
+      break;
+    case MODE_APP:
+      drawAppScreen();
+      break;
+    case MODE_WATCH:
+      drawWatchScreen();
+      break;
+    case MODE_NET:
+      drawNetScreen();
+      break;
+    case MODE_FS:
+      drawFsScreen();
+      break;
+    case MODE_ENERGY:
+      drawEnergyScreen();
+      break;
+    case MODE_HISTORY:
+      drawHistoryScreen();
+      break;
+    case MODE_TAILS:
+      drawTailsScreen();
+      break;
+    case MODE_DEBUG:
+      drawDebugScreen();
+      break;
+    default:
       drawReactorScreen();
+      break;
     }
     lastDrawTime = millis();
+
+    if (frameTrace.id != 0 && dataUpdated) {
+      frameTrace.draw = drawStart;
+      frameTrace.drawDur = frameTrace.push - drawStart;
+      sendTrace();
+      frameTrace.id = 0;
+    }
   }
 }
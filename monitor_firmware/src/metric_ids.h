@@ -0,0 +1,54 @@
+// Generated by monitor_host/registry.py --header; do not edit.
+#pragma once
+
+#include <stdint.h>
+
+#define METRIC_REGISTRY_VERSION 1113385242UL
+#define METRIC_MAX_CORES 16
+
+enum MetricId {
+  M_CPU_LOAD, // %
+  M_CPU_TEMP, // C
+  M_CPU_FREQ, // MHz
+  M_CPU_PWR, // W
+  M_CPU_FAN, // rpm
+  M_CPU_CORES_0, // %
+  M_CPU_CORES_1, // %
+  M_CPU_CORES_2, // %
+  M_CPU_CORES_3, // %
+  M_CPU_CORES_4, // %
+  M_CPU_CORES_5, // %
+  M_CPU_CORES_6, // %
+  M_CPU_CORES_7, // %
+  M_CPU_CORES_8, // %
+  M_CPU_CORES_9, // %
+  M_CPU_CORES_10, // %
+  M_CPU_CORES_11, // %
+  M_CPU_CORES_12, // %
+  M_CPU_CORES_13, // %
+  M_CPU_CORES_14, // %
+  M_CPU_CORES_15, // %
+  M_RAM_USED, // GiB
+  M_RAM_TOTAL, // GiB
+  M_RAM_P, // %
+  M_SWAP_USED, // GiB
+  M_SWAP_P, // %
+  M_GPU_GPU_LOAD, // %
+  M_GPU_VRAM_USED, // MiB
+  M_GPU_VRAM_TOTAL, // MiB
+  M_GPU_VRAM_P, // %
+  M_GPU_GPU_TEMP, // C
+  M_GPU_GPU_PWR, // W
+  M_GPU_GPU_FAN, // %
+  M_DISK_P, // %
+  M_NET_SENT, // MiB
+  M_NET_RECV, // MiB
+  METRIC_COUNT
+};
+
+// Wire values are value * scale, rounded
+static const uint16_t METRIC_SCALE[METRIC_COUNT] = {
+    10, 10, 1, 10, 1, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 1, 10, 10, 10, 1, 10, 1, 10, 10, 10,
+};
@@ -0,0 +1,321 @@
+/*
+ * Optional native readers for the per-tick /proc parsing in collectors.py
+ * and watch.py. Built by build_fastproc.sh; without it the pure-Python code
+ * paths are used and produce the same values.
+ *
+ * Every reader takes a descriptor the caller opened once and preads it from
+ * offset 0 into one module buffer that grows to the largest file seen, so a
+ * tick does no allocation beyond the returned Python objects.
+ *
+ *   CpuStat(fd).sample()  per-CPU busy % since the previous sample
+ *                         (index 0 = aggregate), all 0.0 on the first call
+ *                         or when the CPU count changes
+ *   meminfo(fd)           (MemTotal, MemAvailable or MemFree, SwapTotal,
+ *                         SwapFree) in KiB
+ *   net_dev(fd)           (received, sent) bytes summed over interfaces
+ *   task_ticks(fd)        utime + stime of a /proc/<pid>[/task/<tid>]/stat
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define READ_CHUNK 65536
+
+static char *buf;
+static size_t buf_cap;
+
+/* Whole file into buf, NUL-terminated; same short-read rule as SysFile.read */
+static Py_ssize_t read_all(int fd) {
+  size_t len = 0;
+  for (;;) {
+    if (buf_cap - len < READ_CHUNK + 1) {
+      size_t cap = buf_cap ? buf_cap * 2 : 2 * READ_CHUNK;
+      char *grown = realloc(buf, cap);
+      if (!grown) {
+        PyErr_NoMemory();
+        return -1;
+      }
+      buf = grown;
+      buf_cap = cap;
+    }
+    ssize_t n = pread(fd, buf + len, READ_CHUNK, (off_t)len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      PyErr_SetFromErrno(PyExc_OSError);
+      return -1;
+    }
+    len += (size_t)n;
+    if (n < READ_CHUNK)
+      break;
+  }
+  buf[len] = '\0';
+  return (Py_ssize_t)len;
+}
+
+static const char *skip_spaces(const char *p) {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+/* Unsigned decimal at p (after blanks); *ok is cleared at end of line */
+static uint64_t parse_u64(const char **pp, int *ok) {
+  const char *p = skip_spaces(*pp);
+  if (*p < '0' || *p > '9') {
+    *ok = 0;
+    *pp = p;
+    return 0;
+  }
+  uint64_t v = 0;
+  while (*p >= '0' && *p <= '9')
+    v = v * 10 + (uint64_t)(*p++ - '0');
+  *pp = p;
+  return v;
+}
+
+static const char *next_line(const char *p) {
+  const char *nl = strchr(p, '\n');
+  return nl ? nl + 1 : p + strlen(p);
+}
+
+/* ---- CpuStat ---------------------------------------------------------- */
+
+typedef struct {
+  PyObject_HEAD int fd;
+  Py_ssize_t n;   /* CPUs in prev, 0 before the first sample */
+  Py_ssize_t cap; /* allocated entries in each array */
+  uint64_t *total;
+  uint64_t *idle;
+  uint64_t *prev_total;
+  uint64_t *prev_idle;
+} CpuStat;
+
+static int cpustat_reserve(CpuStat *self, Py_ssize_t need) {
+  if (need <= self->cap)
+    return 0;
+  Py_ssize_t cap = self->cap ? self->cap * 2 : 64;
+  while (cap < need)
+    cap *= 2;
+  uint64_t **arrays[] = {&self->total, &self->idle, &self->prev_total, &self->prev_idle};
+  for (int i = 0; i < 4; i++) {
+    uint64_t *grown = realloc(*arrays[i], (size_t)cap * sizeof(uint64_t));
+    if (!grown) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    *arrays[i] = grown;
+  }
+  self->cap = cap;
+  return 0;
+}
+
+static int cpustat_init(CpuStat *self, PyObject *args, PyObject *kwds) {
+  if (!PyArg_ParseTuple(args, "i", &self->fd))
+    return -1;
+  self->n = 0;
+  return 0;
+}
+
+static void cpustat_dealloc(CpuStat *self) {
+  free(self->total);
+  free(self->idle);
+  free(self->prev_total);
+  free(self->prev_idle);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *cpustat_sample(CpuStat *self, PyObject *unused) {
+  if (read_all(self->fd) < 0)
+    return NULL;
+  Py_ssize_t count = 0;
+  for (const char *p = buf; strncmp(p, "cpu", 3) == 0; p = next_line(p)) {
+    if (cpustat_reserve(self, count + 1) < 0)
+      return NULL;
+    const char *q = p + 3;
+    while (*q && *q != ' ')
+      q++;
+    uint64_t v[8] = {0};
+    int ok = 1;
+    /* guest and guest_nice are already counted in user and nice */
+    for (int i = 0; i < 8 && ok; i++)
+      v[i] = parse_u64(&q, &ok);
+    uint64_t total = 0;
+    for (int i = 0; i < 8; i++)
+      total += v[i];
+    self->total[count] = total;
+    self->idle[count] = v[3] + v[4];
+    count++;
+  }
+
+  PyObject *out = PyList_New(count);
+  if (!out)
+    return NULL;
+  int delta = self->n == count;
+  for (Py_ssize_t i = 0; i < count; i++) {
+    double load = 0.0;
+    if (delta) {
+      uint64_t dt = self->total[i] - self->prev_total[i];
+      /* iowait can go backwards: count no idle time rather than wrap, and
+         never more than the elapsed total, so load stays in 0..100 */
+      uint64_t di = 0;
+      if (self->idle[i] > self->prev_idle[i])
+        di = self->idle[i] - self->prev_idle[i];
+      if (self->total[i] > self->prev_total[i]) {
+        if (di > dt)
+          di = dt;
+        /* Permille rounded half to even on the exact ratio, as in
+           collectors.CpuCollector, so both backends give the same frame */
+        uint64_t busy = (dt - di) * 1000, q = busy / dt, r = busy % dt;
+        if (2 * r > dt || (2 * r == dt && (q & 1)))
+          q++;
+        load = (double)q / 10.0;
+      }
+    }
+    PyObject *f = PyFloat_FromDouble(load);
+    if (!f) {
+      Py_DECREF(out);
+      return NULL;
+    }
+    PyList_SET_ITEM(out, i, f);
+  }
+  uint64_t *t = self->prev_total;
+  self->prev_total = self->total;
+  self->total = t;
+  t = self->prev_idle;
+  self->prev_idle = self->idle;
+  self->idle = t;
+  self->n = count;
+  return out;
+}
+
+static PyMethodDef cpustat_methods[] = {
+    {"sample", (PyCFunction)cpustat_sample, METH_NOARGS,
+     "Per-CPU busy % since the last sample (index 0 = all CPUs)"},
+    {NULL}};
+
+static PyTypeObject CpuStatType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "_fastproc.CpuStat",
+    .tp_basicsize = sizeof(CpuStat),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Delta reader for /proc/stat cpu lines",
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)cpustat_init,
+    .tp_dealloc = (destructor)cpustat_dealloc,
+    .tp_methods = cpustat_methods,
+};
+
+/* ---- single-shot readers ---------------------------------------------- */
+
+static PyObject *fp_meminfo(PyObject *mod, PyObject *args) {
+  int fd;
+  if (!PyArg_ParseTuple(args, "i", &fd))
+    return NULL;
+  if (read_all(fd) < 0)
+    return NULL;
+  static const char *keys[] = {"MemTotal:", "MemAvailable:", "MemFree:", "SwapTotal:", "SwapFree:"};
+  uint64_t v[5] = {0};
+  int seen[5] = {0};
+  for (const char *p = buf; *p; p = next_line(p)) {
+    for (int i = 0; i < 5; i++) {
+      size_t len = strlen(keys[i]);
+      if (!seen[i] && strncmp(p, keys[i], len) == 0) {
+        const char *q = p + len;
+        int ok = 1;
+        v[i] = parse_u64(&q, &ok);
+        seen[i] = 1;
+        break;
+      }
+    }
+  }
+  uint64_t available = seen[1] ? v[1] : v[2];
+  return Py_BuildValue("(KKKK)", (unsigned long long)v[0], (unsigned long long)available,
+                       (unsigned long long)v[3], (unsigned long long)v[4]);
+}
+
+static PyObject *fp_net_dev(PyObject *mod, PyObject *args) {
+  int fd;
+  if (!PyArg_ParseTuple(args, "i", &fd))
+    return NULL;
+  if (read_all(fd) < 0)
+    return NULL;
+  uint64_t recv = 0, sent = 0;
+  /* Two header lines, then "iface: rx_bytes ... (8 rx columns) tx_bytes ..." */
+  const char *p = next_line(next_line(buf));
+  for (; *p; p = next_line(p)) {
+    const char *colon = strchr(p, ':');
+    const char *end = strchr(p, '\n');
+    if (!colon || (end && colon > end))
+      continue;
+    const char *q = colon + 1;
+    uint64_t v[9];
+    int ok = 1;
+    for (int i = 0; i < 9 && ok; i++)
+      v[i] = parse_u64(&q, &ok);
+    if (ok) {
+      recv += v[0];
+      sent += v[8];
+    }
+  }
+  return Py_BuildValue("(KK)", (unsigned long long)recv, (unsigned long long)sent);
+}
+
+static PyObject *fp_task_ticks(PyObject *mod, PyObject *args) {
+  int fd;
+  if (!PyArg_ParseTuple(args, "i", &fd))
+    return NULL;
+  if (read_all(fd) < 0)
+    return NULL;
+  /* comm may contain spaces and ')'; fields resume after the last ')' */
+  const char *p = strrchr(buf, ')');
+  if (!p) {
+    PyErr_SetString(PyExc_ValueError, "malformed stat line");
+    return NULL;
+  }
+  p++;
+  /* Skip state and the next 10 fields to reach utime (field 14) */
+  for (int i = 0; i < 11; i++) {
+    p = skip_spaces(p);
+    while (*p && *p != ' ')
+      p++;
+  }
+  int ok = 1;
+  uint64_t utime = parse_u64(&p, &ok);
+  uint64_t stime = parse_u64(&p, &ok);
+  if (!ok) {
+    PyErr_SetString(PyExc_ValueError, "malformed stat line");
+    return NULL;
+  }
+  return PyLong_FromUnsignedLongLong(utime + stime);
+}
+
+static PyMethodDef fp_methods[] = {
+    {"meminfo", fp_meminfo, METH_VARARGS, "(total, available, swap_total, swap_free) KiB"},
+    {"net_dev", fp_net_dev, METH_VARARGS, "(received, sent) bytes over all interfaces"},
+    {"task_ticks", fp_task_ticks, METH_VARARGS, "utime + stime from a stat file"},
+    {NULL}};
+
+static struct PyModuleDef fp_module = {
+    PyModuleDef_HEAD_INIT, "_fastproc", "Native /proc readers for the CYD host monitor", -1,
+    fp_methods};
+
+PyMODINIT_FUNC PyInit__fastproc(void) {
+  if (PyType_Ready(&CpuStatType) < 0)
+    return NULL;
+  PyObject *m = PyModule_Create(&fp_module);
+  if (!m)
+    return NULL;
+  Py_INCREF(&CpuStatType);
+  if (PyModule_AddObject(m, "CpuStat", (PyObject *)&CpuStatType) < 0) {
+    Py_DECREF(&CpuStatType);
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
@@ -0,0 +1,367 @@
+"""Remote agent and aggregator for cluster views.
+
+An agent streams compact binary samples over one long-lived TCP connection:
+
+    hello   "CYDA" u8 version, u8 name length, name, u16 field count,
+            u16 names length, NUL-separated field names
+    sample  u16 length, u32 seq, f64 agent unix time, f32 values[field count]
+
+The agent connects from a short-lived thread, with backoff, so an
+aggregator that is down or unresolvable never holds up the sampling tick;
+samples taken meanwhile are dropped. A send that cannot complete within
+SEND_TIMEOUT drops the connection, and the next one starts with a new hello.
+
+The aggregator multiplexes all agent sockets with a selector, keeps only the
+latest sample per host and adds per-host summaries to the local frame. A host
+silent for EXPIRE_AFTER seconds is dropped from the cluster view.
+"""
+import math
+import selectors
+import socket
+import struct
+import sys
+import threading
+import time
+
+from registry import NAMES, reader
+
+MAGIC = b"CYDA"
+VERSION = 1
+HELLO = struct.Struct("<4sBB")
+COUNT = struct.Struct("<H")
+SAMPLE_HEAD = struct.Struct("<HId")
+
+DEFAULT_PORT = 7878
+STALE_AFTER = 5.0
+EXPIRE_AFTER = 12 * STALE_AFTER
+CONNECT_TIMEOUT = 5.0
+SEND_TIMEOUT = 0.1
+MAX_DISPLAY_HOSTS = 8
+# Offset estimates older than this are re-learnt so a stepped clock recovers
+SKEW_WINDOW = 300.0
+
+
+def parse_addr(text, default_host=""):
+    host, _, port = text.rpartition(":")
+    return (host or default_host, int(port) if port else DEFAULT_PORT)
+
+
+class AgentClient:
+    """Sink that forwards every sample to an aggregator"""
+
+    def __init__(self, addr, name=None, fields=NAMES):
+        self.addr = addr
+        self.name = (name or socket.gethostname())[:32]
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.body = struct.Struct(f"<{len(self.fields)}f")
+        names = b"\0".join(f.encode() for f in self.fields)
+        self.hello = (HELLO.pack(MAGIC, VERSION, len(self.name.encode())) + self.name.encode()
+                      + COUNT.pack(len(self.fields)) + COUNT.pack(len(names)) + names)
+        self.sock = None
+        self.seq = 0
+        self.next_retry = 0
+        self.backoff = 1
+        self.connecting = None
+        self.closed = False
+
+    def _connect(self):
+        """Runs on the connect thread; hands over a ready socket"""
+        try:
+            sock = socket.create_connection(self.addr, timeout=CONNECT_TIMEOUT)
+        except OSError as e:
+            print(f"Agent connect failed: {e}", file=sys.stderr)
+            self.next_retry = time.monotonic() + self.backoff
+            self.backoff = min(self.backoff * 2, 30)
+            return
+        try:
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            sock.sendall(self.hello)
+            sock.settimeout(SEND_TIMEOUT)
+        except OSError as e:
+            print(f"Agent hello failed: {e}", file=sys.stderr)
+            sock.close()
+            self.next_retry = time.monotonic() + self.backoff
+            self.backoff = min(self.backoff * 2, 30)
+            return
+        if self.closed:
+            sock.close()
+            return
+        self.backoff = 1
+        self.sock = sock
+        print(f"Agent connected to {self.addr[0]}:{self.addr[1]}")
+
+    def publish(self, data, ts=None):
+        sock = self.sock
+        if sock is None:
+            busy = self.connecting is not None and self.connecting.is_alive()
+            if not busy and time.monotonic() >= self.next_retry:
+                self.connecting = threading.Thread(target=self._connect, name="agent-connect", daemon=True)
+                self.connecting.start()
+            return
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        payload = self.body.pack(*self.read(data))
+        frame = SAMPLE_HEAD.pack(4 + 8 + len(payload), self.seq, time.time() if ts is None else ts) + payload
+        try:
+            sock.sendall(frame)
+        except OSError as e:
+            # A partly sent frame would desync the stream: start over
+            print(f"Agent send failed: {e}", file=sys.stderr)
+            self._disconnect()
+            self.next_retry = time.monotonic() + self.backoff
+
+    def _disconnect(self):
+        if self.sock:
+            try:
+                self.sock.close()
+            except OSError:
+                pass
+        self.sock = None
+
+    def close(self):
+        self.closed = True
+        self._disconnect()
+
+
+class _Peer:
+    __slots__ = ("sock", "addr", "buf", "name", "fields", "body", "columns",
+                 "latest", "ts", "recv_mono", "offset", "offset_mono", "samples")
+
+    def __init__(self, sock, addr):
+        self.sock = sock
+        self.addr = addr
+        self.buf = bytearray()
+        self.name = None
+        self.fields = None
+        self.body = None
+        self.columns = None
+        self.latest = None
+        self.ts = 0.0
+        self.recv_mono = 0.0
+        self.offset = None
+        self.offset_mono = 0.0
+        self.samples = 0
+
+
+class Aggregator:
+    """Source that merges agent streams into a per-host summary list"""
+    name = "cluster"
+
+    # Summary columns sent to the display: key -> field name
+    SUMMARY = (("c", "cpu.load"), ("t", "cpu.temp"), ("r", "ram.p"), ("g", "gpu.gpu_load"))
+
+    def __init__(self, addr, local_name=None):
+        self.sel = selectors.DefaultSelector()
+        self.listener = socket.create_server(addr, backlog=128)
+        self.listener.setblocking(False)
+        self.sel.register(self.listener, selectors.EVENT_READ, None)
+        self.port = self.listener.getsockname()[1]
+        self.hosts = {}
+        self.local_name = (local_name or socket.gethostname())[:32]
+        self.local_read = reader([f for _, f in self.SUMMARY])
+        print(f"Aggregating agents on port {self.port}")
+
+    def poll(self, timeout=0):
+        """Drain every readable socket without blocking"""
+        for key, _ in self.sel.select(timeout):
+            if key.data is None:
+                self._accept()
+            else:
+                self._read(key.data)
+
+    def _accept(self):
+        while True:
+            try:
+                sock, addr = self.listener.accept()
+            except (BlockingIOError, InterruptedError):
+                return
+            sock.setblocking(False)
+            self.sel.register(sock, selectors.EVENT_READ, _Peer(sock, addr))
+
+    def _drop(self, peer):
+        self.sel.unregister(peer.sock)
+        peer.sock.close()
+        if peer.name and self.hosts.get(peer.name) is peer:
+            # Keep the last values around so the host shows as stale, not gone
+            peer.sock = None
+
+    def _read(self, peer):
+        try:
+            chunk = peer.sock.recv(65536)
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            chunk = b""
+        if not chunk:
+            self._drop(peer)
+            return
+        peer.buf += chunk
+        try:
+            self._parse(peer)
+        except (ValueError, struct.error) as e:
+            print(f"Agent {peer.addr[0]}: bad stream ({e}), closing", file=sys.stderr)
+            self._drop(peer)
+
+    def _parse(self, peer):
+        buf = peer.buf
+        pos = 0
+        if peer.name is None:
+            if len(buf) < HELLO.size:
+                return
+            magic, version, name_len = HELLO.unpack_from(buf, 0)
+            if magic != MAGIC or version != VERSION:
+                raise ValueError("bad hello")
+            need = HELLO.size + name_len + 2 * COUNT.size
+            if len(buf) < need:
+                return
+            count = COUNT.unpack_from(buf, HELLO.size + name_len)[0]
+            names_len = COUNT.unpack_from(buf, HELLO.size + name_len + 2)[0]
+            if len(buf) < need + names_len:
+                return
+            peer.name = bytes(buf[HELLO.size:HELLO.size + name_len]).decode(errors="replace")
+            peer.fields = bytes(buf[need:need + names_len]).decode().split("\0")
+            if len(peer.fields) != count:
+                raise ValueError("field count mismatch")
+            peer.body = struct.Struct(f"<{count}f")
+            # Map this agent's layout onto the summary columns once
+            index = {f: i for i, f in enumerate(peer.fields)}
+            peer.columns = [index.get(f) for _, f in self.SUMMARY]
+            old = self.hosts.get(peer.name)
+            if old is not None and old.sock is not None and old is not peer:
+                self._drop(old)
+            self.hosts[peer.name] = peer
+            pos = need + names_len
+
+        while len(buf) - pos >= 2:
+            length = COUNT.unpack_from(buf, pos)[0]
+            if len(buf) - pos - 2 < length:
+                break
+            _, seq, ts = SAMPLE_HEAD.unpack_from(buf, pos)
+            if length - 12 != peer.body.size:
+                raise ValueError("sample size mismatch")
+            values = peer.body.unpack_from(buf, pos + SAMPLE_HEAD.size)
+            self._store(peer, ts, values)
+            pos += 2 + length
+        del buf[:pos]
+
+    def _store(self, peer, ts, values):
+        now_mono = time.monotonic()
+        # Network delay is never negative, so the smallest (local - remote)
+        # difference seen is the best estimate of clock skew
+        offset = time.time() - ts
+        if peer.offset is None or offset < peer.offset or now_mono - peer.offset_mono > SKEW_WINDOW:
+            peer.offset = offset
+            peer.offset_mono = now_mono
+        peer.ts = ts
+        peer.recv_mono = now_mono
+        peer.samples += 1
+        peer.latest = tuple(values[i] if i is not None else math.nan for i in peer.columns)
+
+    def contribute(self, data):
+        """Add the merged cluster view to this tick's frame"""
+        self.poll()
+        now_mono = time.monotonic()
+        now = time.time()
+        rows = [(self.local_name, 0, self.local_read(data))]
+        stale = 0
+        for name, peer in list(self.hosts.items()):
+            if peer.recv_mono == 0:
+                continue
+            # A live connection can still deliver old samples (agent stalled
+            # and flushed), so age by the skew-corrected sample time as well
+            age = max(now_mono - peer.recv_mono, now - (peer.ts + peer.offset))
+            if age > EXPIRE_AFTER:
+                print(f"Agent {name} silent for {age:.0f}s, dropped from the cluster view")
+                del self.hosts[name]
+                if peer.sock is not None:
+                    self._drop(peer)
+                continue
+            is_stale = age > STALE_AFTER or peer.sock is None
+            stale += is_stale
+            rows.append((name, int(is_stale), peer.latest))
+        # Local host first, then busiest remote hosts
+        head, rest = rows[:1], sorted(rows[1:], key=lambda r: (r[1], -_num(r[2][0])))
+        shown = head + rest[:MAX_DISPLAY_HOSTS - 1]
+        data["hosts"] = [
+            dict({"n": name[:10], "s": s}, **{k: round(_num(v), 1) for (k, _), v in zip(self.SUMMARY, vals)})
+            for name, s, vals in shown
+        ]
+        data["hn"] = len(rows)
+        data["hs"] = stale
+
+    def skew(self):
+        """Estimated clock offsets (local - agent) per host in seconds"""
+        return {name: p.offset for name, p in self.hosts.items() if p.offset is not None}
+
+    def close(self):
+        for key in list(self.sel.get_map().values()):
+            key.fileobj.close()
+        self.sel.close()
+
+
+def _num(v):
+    return 0.0 if v != v else v
+
+
+def _loopback_demo(n_agents=50, ticks=20):
+    """Drive n agents against an aggregator over loopback and report cost"""
+    global EXPIRE_AFTER
+    agg = Aggregator(("127.0.0.1", 0))
+    agents = [AgentClient(("127.0.0.1", agg.port), name=f"node{i:02d}") for i in range(n_agents)]
+    sample = {"cpu": {"load": 50.0, "temp": 60.0, "cores": [1.0] * 16}, "ram": {"p": 40.0}, "gpu": {"gpu_load": 5}}
+    # Connects happen off the tick; wait for them before timing
+    for a in agents:
+        a.publish(sample)
+    deadline = time.monotonic() + 5
+    while any(a.sock is None for a in agents) and time.monotonic() < deadline:
+        agg.poll(0.01)
+    assert all(a.sock is not None for a in agents), "agents did not connect"
+    sent = 0
+    start = time.perf_counter()
+    for tick in range(ticks):
+        for a in agents:
+            sample["cpu"]["load"] = float((tick * 7 + a.seq) % 100)
+            a.publish(sample)
+            sent += 1
+        agg.poll(0.01)
+    agg.poll(0.05)
+    frame = {"cpu": {"load": 1.0}}
+    agg.contribute(frame)
+    elapsed = time.perf_counter() - start
+    frame_bytes = SAMPLE_HEAD.size + agents[0].body.size
+    print(f"{n_agents} agents x {ticks} ticks: {elapsed / sent * 1e6:.1f} us/sample end to end, "
+          f"{frame_bytes} bytes/sample on the wire")
+    print(f"hosts={frame['hn']} stale={frame['hs']} shown={[h['n'] for h in frame['hosts']]}")
+    assert frame["hn"] == n_agents + 1 and frame["hs"] == 0, "hosts missing or stale"
+    # The dict is reused between ticks: the last values must arrive, not the first
+    last = agg.hosts["node00"].latest[0]
+    assert last == float(((ticks - 1) * 7 + agents[0].seq - 1) % 100), f"stale load {last}"
+
+    # An unreachable aggregator costs the tick nothing while it connects
+    dead = AgentClient(("192.0.2.1", DEFAULT_PORT), name="dead")
+    start = time.perf_counter()
+    for _ in range(5):
+        dead.publish(sample)
+    worst = (time.perf_counter() - start) / 5 * 1e3
+    print(f"publish to an unreachable aggregator: {worst:.2f} ms/tick")
+    assert worst < 5, "publish blocked on connect"
+    dead.close()
+
+    # Agents that leave expire from the cluster view
+    for a in agents[1:]:
+        a.close()
+    EXPIRE_AFTER = 0.2
+    time.sleep(0.3)
+    agents[0].publish(sample)
+    agg.poll(0.05)
+    frame = {"cpu": {"load": 1.0}}
+    agg.contribute(frame)
+    print(f"after {n_agents - 1} agents left: hosts={frame['hn']}")
+    assert frame["hn"] == 2 and set(agg.hosts) == {"node00"}, "departed hosts not expired"
+    agents[0].close()
+    agg.close()
+    print("agent check passed")
+
+
+if __name__ == "__main__":
+    _loopback_demo(int(sys.argv[1]) if len(sys.argv) > 1 else 50)
@@ -0,0 +1,208 @@
+"""Threshold alerts with hysteresis, hold times and rate-of-change rules.
+
+Rules are loaded from JSON (a list, or {"rules": [...]}) and compiled into
+parallel arrays, so a tick is one pass over the table with no dict lookups:
+
+    {"name": "CPU", "field": "cpu.load", "above": 80, "clear": 75, "for": 3}
+    {"name": "TEMP+", "field": "cpu.temp", "rate": true, "above": 2, "for": 5}
+    {"name": "FAN", "field": "cpu.fan", "below": 300, "severity": "crit"}
+
+    above/below   trigger level (rate rules compare units per second)
+    clear         level the value must return past before the alert clears
+                  (default: the trigger level, i.e. no hysteresis band); a
+                  level past the trigger is rejected at load time
+    for           seconds the trigger must hold before the alert fires
+    clear_for     seconds the clear condition must hold before it clears
+    severity      "warn" (default) or "crit"
+    line          STATS row to colour (cpu, gpu, pwr, vram, ram, swap, disk);
+                  derived from the field by default
+
+State changes are returned as {"t": "alert"} frames that the manager writes
+ahead of the stats frame; the stats frame carries the active row masks so a
+device that missed a transition resyncs on the next tick.
+"""
+import json
+import sys
+import time
+
+from anomaly import line_bit
+from registry import reader
+
+DEFAULT_RULES = [
+    {"name": "CPU", "field": "cpu.load", "above": 80, "clear": 75, "for": 3},
+    {"name": "GPU", "field": "gpu.gpu_load", "above": 80, "clear": 75, "for": 3},
+    {"name": "RAM", "field": "ram.p", "above": 85, "clear": 82},
+    {"name": "SWAP", "field": "swap.p", "above": 50, "clear": 45},
+    {"name": "DISK", "field": "disk.p", "above": 90, "clear": 88},
+]
+
+LINES = {"cpu": 1, "gpu": 2, "pwr": 4, "vram": 8, "ram": 16, "swap": 32, "disk": 64}
+
+
+def load_rules(path):
+    with open(path) as f:
+        rules = json.load(f)
+    if isinstance(rules, dict):
+        rules = rules.get("rules", [])
+    return rules
+
+
+class AlertEngine:
+    """Source evaluating the rule table once per tick"""
+    name = "alerts"
+    # Runs every tick whatever the overhead budget, so no edge is missed
+    throttle = False
+
+    def __init__(self, rules=DEFAULT_RULES):
+        self.names = []
+        fields = []
+        self.sign = []
+        self.on = []
+        self.off = []
+        self.hold = []
+        self.clear_hold = []
+        self.rate = []
+        self.crit = []
+        self.bits = []
+        for r in rules:
+            if ("above" in r) == ("below" in r):
+                raise ValueError(f"alert rule {r.get('name', r.get('field'))}: needs exactly one of above/below")
+            # Rules are normalised to "sign * value > on" so evaluation has no branches on direction
+            sign = 1.0 if "above" in r else -1.0
+            on = r["above"] if "above" in r else r["below"]
+            if sign * r.get("clear", on) > sign * on:
+                # The clear level would be crossed on every tick the alert is up
+                side = "below" if sign > 0 else "above"
+                raise ValueError(f"alert rule {r.get('name', r.get('field'))}: clear {r['clear']} "
+                                 f"must be at or {side} the trigger {on}")
+            self.names.append(str(r.get("name", r["field"]))[:8])
+            fields.append(r["field"])
+            self.sign.append(sign)
+            self.on.append(sign * on)
+            self.off.append(sign * r.get("clear", on))
+            self.hold.append(float(r.get("for", 0)))
+            self.clear_hold.append(float(r.get("clear_for", 0)))
+            self.rate.append(bool(r.get("rate", False)))
+            self.crit.append(r.get("severity", "warn") == "crit")
+            self.bits.append(LINES[r["line"]] if "line" in r else line_bit(r["field"]))
+        self.read = reader(fields)
+        n = len(self.names)
+        self.active = [False] * n
+        self.since = [None] * n
+        self.prev = [None] * n
+        self.prev_ts = None
+        self.pending = []
+
+    def evaluate(self, values, now):
+        """Advance every rule by one sample; returns the transitions"""
+        dt = now - self.prev_ts if self.prev_ts is not None else 0.0
+        self.prev_ts = now
+        changes = []
+        for i, v in enumerate(values):
+            if self.rate[i]:
+                prev = self.prev[i]
+                self.prev[i] = v
+                if prev is None or dt <= 0:
+                    continue
+                v = (v - prev) / dt
+            if v != v:
+                continue
+            x = self.sign[i] * v
+            if not self.active[i]:
+                if x > self.on[i]:
+                    if self.since[i] is None:
+                        self.since[i] = now
+                    if now - self.since[i] >= self.hold[i]:
+                        self.active[i] = True
+                        self.since[i] = None
+                        changes.append((i, True, v))
+                else:
+                    self.since[i] = None
+            else:
+                if x <= self.off[i]:
+                    if self.since[i] is None:
+                        self.since[i] = now
+                    if now - self.since[i] >= self.clear_hold[i]:
+                        self.active[i] = False
+                        self.since[i] = None
+                        changes.append((i, False, v))
+                else:
+                    self.since[i] = None
+        return changes
+
+    def contribute(self, data):
+        changes = self.evaluate(self.read(data), time.monotonic())
+        for i, on, v in changes:
+            state = "FIRING" if on else "cleared"
+            print(f"Alert {self.names[i]} {state} ({v:g})")
+            self.pending.append({"t": "alert", "n": self.names[i], "on": int(on),
+                                 "crit": int(self.crit[i]), "v": round(v, 1)})
+        warn = crit = count = 0
+        for i, active in enumerate(self.active):
+            if active:
+                count += 1
+                if self.crit[i]:
+                    crit |= self.bits[i]
+                else:
+                    warn |= self.bits[i]
+        data["al"] = {"w": warn, "c": crit, "n": count}
+
+    def frames(self, now):
+        frames, self.pending = self.pending, []
+        return frames
+
+    def close(self):
+        pass
+
+
+if __name__ == "__main__":
+    # Raise after the hold, stay up inside the band, clear past it
+    engine = AlertEngine([{"name": "CPU", "field": "cpu.load", "above": 80, "clear": 75, "for": 3},
+                          {"name": "FAN", "field": "cpu.fan", "below": 300, "clear_for": 2},
+                          {"name": "TEMP+", "field": "cpu.temp", "rate": True, "above": 2}])
+    script = [  # t, load, fan, temp -> expected transitions
+        (0, 85, 1000, 50, []),
+        (1, 85, 1000, 50, []),
+        (2, 50, 1000, 50, []),           # hold interrupted
+        (3, 85, 1000, 50, []),
+        (6, 85, 1000, 50, [("CPU", True)]),
+        (7, 78, 250, 60, [("FAN", True), ("TEMP+", True)]),
+        (8, 74, 250, 60, [("CPU", False), ("TEMP+", False)]),
+        (9, 74, 400, 60, []),
+        (10, 74, 250, 60, []),           # clear_for interrupted
+        (11, 74, 400, 60, []),
+        (13, 74, 400, 60, [("FAN", False)]),
+    ]
+    for t, load, fan, temp, expect in script:
+        got = [(engine.names[i], on) for i, on, _ in engine.evaluate([load, fan, temp], float(t))]
+        assert got == expect, (t, got, expect)
+
+    for bad in ({"field": "cpu.load", "above": 80, "clear": 85},
+                {"field": "cpu.fan", "below": 300, "clear": 250},
+                {"field": "cpu.load", "above": 80, "below": 10}):
+        try:
+            AlertEngine([bad])
+            raise AssertionError(f"accepted {bad}")
+        except ValueError as e:
+            print("rejected:", e)
+
+    # Flapping check: a load hovering around the CPU threshold
+    import random
+    random.seed(1)
+    engine = AlertEngine()
+    flips = naive = 0
+    last = False
+    t = 0.0
+    for _ in range(3600):
+        v = 80 + random.gauss(0, 3)
+        flips += len(engine.evaluate([v, 0, 0, 0, 0], t))
+        naive += (v > 80) != last
+        last = v > 80
+        t += 1.0
+    print(f"1 h at 80+-3% load: {naive} naive transitions, {flips} alert transitions")
+    assert flips * 10 < naive, (flips, naive)
+    n = 100000
+    start = time.perf_counter()
+    for i in range(n):
+        engine.evaluate([50.0, 50.0, 50.0, 10.0, 50.0], t + i)
+    print(f"{(time.perf_counter() - start) / n * 1e6:.2f} us/tick for {len(engine.names)} rules")
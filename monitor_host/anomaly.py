@@ -0,0 +1,325 @@
+"""Streaming anomaly detection on collected metrics.
+
+Every metric gets an O(1) detector with no history scans:
+
+    spike   |z| against an EWMA mean/variance stays above Z_THRESHOLD
+    trend   EWMA of the per-sample change is significantly non-zero and
+            projects a large move over TREND_HORIZON samples (VRAM creep)
+    stuck   a percentage metric stays pinned at its ceiling (core at 100%)
+
+Flags need PERSIST consecutive hits to fire and clear with hysteresis, and
+nothing fires during the warm-up, so one noisy sample never reaches the
+display. `anomaly.py --replay RING_STORE` runs the detectors over recorded
+history to measure how often they fire on normal traffic. `anomaly.py
+--check` replays a seeded synthetic day with planted events (a temperature
+spike, a VRAM creep, a pinned core) and exits 1 when a planted event is
+missed or the detectors fire elsewhere more than MAX_FALSE_PER_HOUR.
+"""
+import math
+import random
+import sys
+import time
+
+from registry import NAMES, reader
+
+ALPHA = 2.0 / (300 + 1)
+TREND_ALPHA = 2.0 / (600 + 1)
+WARMUP = 120
+# Double smoothing needs a few of its own time constants before it is trusted
+TREND_WARMUP = 3 * 600
+Z_THRESHOLD = 4.0
+Z_CLEAR = 2.0
+TREND_T = 5.0
+TREND_HORIZON = 600
+PERSIST = 3
+STUCK_LEVEL = 99.0
+STUCK_SAMPLES = 60
+# Variance floor so a perfectly flat metric does not turn every wiggle into a spike
+MIN_STD_FRACTION = 0.02
+MIN_STD = 0.5
+# Spread of the double-smoothed slope on white noise, in units of noise std;
+# measured, roughly 0.5 * alpha ** 1.5
+SLOPE_NOISE = 0.5 * TREND_ALPHA ** 1.5
+
+# Which row on the STATS page each metric family lights up
+LINE_BITS = (
+    ("cpu.cores.", 1), ("cpu.", 1),
+    ("gpu.gpu_pwr", 4), ("gpu.vram", 8), ("gpu.", 2),
+    ("ram.", 16), ("swap.", 32), ("disk.", 64),
+)
+
+KIND_SPIKE = "spike"
+KIND_TREND = "trend"
+KIND_STUCK = "stuck"
+
+
+def line_bit(name):
+    for prefix, bit in LINE_BITS:
+        if name.startswith(prefix):
+            return bit
+    return 0
+
+
+class Detector:
+    __slots__ = ("percent", "n", "mean", "var", "prev", "d_abs", "level", "level2", "trend_n",
+                 "spike_hits", "trend_hits", "stuck_hits", "flags")
+
+    def __init__(self, percent=False):
+        self.percent = percent
+        self.n = 0
+        self.mean = 0.0
+        self.var = 0.0
+        self.prev = 0.0
+        self.d_abs = 0.0
+        self.level = self.level2 = 0.0
+        self.trend_n = 0
+        self.spike_hits = 0
+        self.trend_hits = 0
+        self.stuck_hits = 0
+        self.flags = set()
+
+    def update(self, x):
+        """Feed one sample; returns the set of active flags"""
+        if x != x:
+            return self.flags
+        self.n += 1
+        if self.n == 1:
+            self.mean = self.prev = self.level = self.level2 = x
+            return self.flags
+
+        # Spike: score against the state before this sample is absorbed
+        std = max(math.sqrt(self.var), abs(self.mean) * MIN_STD_FRACTION, MIN_STD)
+        z = (x - self.mean) / std
+        diff = x - self.mean
+        self.mean += ALPHA * diff
+        self.var = (1 - ALPHA) * (self.var + ALPHA * diff * diff)
+
+        # Trend: Brown's double exponential smoothing gives a slope that is
+        # itself smooth. Its noise is judged from mean |change| between
+        # samples (E|d| = 1.13 std for gaussian noise) because the EWMA
+        # variance is inflated by lag while the metric is ramping
+        self.d_abs += TREND_ALPHA * (abs(x - self.prev) - self.d_abs)
+        self.prev = x
+        self.level += TREND_ALPHA * (x - self.level)
+        self.level2 += TREND_ALPHA * (self.level - self.level2)
+        self.trend_n += 1
+
+        if self.n < WARMUP:
+            return self.flags
+
+        spiked = KIND_SPIKE in self.flags
+        self._hysteresis(KIND_SPIKE, abs(z) > Z_THRESHOLD, abs(z) < Z_CLEAR, "spike_hits")
+        if KIND_SPIKE in self.flags and not spiked:
+            # A level shift would read as a ramp for the next few time
+            # constants; restart the trend from the new level instead
+            self.level = self.level2 = x
+            self.trend_n = 0
+            self.flags.discard(KIND_TREND)
+
+        slope = TREND_ALPHA / (1 - TREND_ALPHA) * (self.level - self.level2)
+        t = slope / (SLOPE_NOISE * self.d_abs / 1.13 + 1e-9)
+        moving = abs(slope) * TREND_HORIZON > 2 * std
+        hit = self.trend_n >= TREND_WARMUP and abs(t) > TREND_T and moving
+        self._hysteresis(KIND_TREND, hit, abs(t) < TREND_T / 2, "trend_hits")
+
+        if self.percent:
+            pinned = x >= STUCK_LEVEL
+            self.stuck_hits = self.stuck_hits + 1 if pinned else 0
+            if self.stuck_hits >= STUCK_SAMPLES:
+                self.flags.add(KIND_STUCK)
+            elif not pinned:
+                self.flags.discard(KIND_STUCK)
+        return self.flags
+
+    def _hysteresis(self, kind, hit, clear, counter):
+        hits = getattr(self, counter)
+        if hit:
+            hits += 1
+            if hits >= PERSIST:
+                self.flags.add(kind)
+        else:
+            hits = 0
+            if clear:
+                self.flags.discard(kind)
+        setattr(self, counter, hits)
+
+
+def _is_percent(name):
+    return name.endswith((".p", ".load", "_load", "_p")) or ".cores." in name
+
+
+class AnomalyMonitor:
+    """Source running one detector per metric and flagging the frame"""
+    name = "anomaly"
+
+    # Absolute counters and capacities are not meaningful to score
+    SKIP = ("net.sent", "net.recv", "ram.total", "gpu.vram_total", "cpu.freq")
+
+    def __init__(self, fields=NAMES):
+        self.fields = [f for f in fields if f not in self.SKIP]
+        self.read = reader(self.fields)
+        self.detectors = [Detector(_is_percent(f)) for f in self.fields]
+        self.bits = [line_bit(f) for f in self.fields]
+        self.core_bits = [1 << int(f.rsplit(".", 1)[1]) if f.startswith("cpu.cores.") else 0 for f in self.fields]
+        self.fired = 0
+
+    def evaluate(self, values):
+        """Return (line mask, core mask, [(field, kinds)]) for one sample"""
+        lines = cores = 0
+        active = []
+        for i, (det, v) in enumerate(zip(self.detectors, values)):
+            flags = det.update(v)
+            if flags:
+                lines |= self.bits[i]
+                cores |= self.core_bits[i]
+                active.append((self.fields[i], flags))
+        return lines, cores, active
+
+    def contribute(self, data):
+        lines, cores, active = self.evaluate(self.read(data))
+        if active:
+            field, flags = active[0]
+            data["anom"] = {"l": lines, "c": cores, "n": len(active),
+                            "txt": f"{field.split('.', 1)[-1]} {'/'.join(sorted(flags))}"[:24]}
+
+    def close(self):
+        pass
+
+
+def replay(path):
+    """Run the detectors over a ring store and report firing rates"""
+    from tsdb import RingReader
+    reader = RingReader(path)
+    fields = [f for f in reader.fields if f not in AnomalyMonitor.SKIP]
+    mon = AnomalyMonitor(fields)
+    series = [reader.range(f)[1] for f in fields]
+    ts = reader.range(fields[0])[0]
+    if not ts:
+        print("ring store is empty")
+        return
+    hours = max((ts[-1] - ts[0]) / 3600, 1e-9)
+    onsets = {f: {} for f in fields}
+    prev = [set() for _ in fields]
+    start = time.perf_counter()
+    for i in range(len(ts)):
+        mon.evaluate([s[i] for s in series])
+        for j, det in enumerate(mon.detectors):
+            for kind in det.flags - prev[j]:
+                onsets[fields[j]][kind] = onsets[fields[j]].get(kind, 0) + 1
+            prev[j] = set(det.flags)
+    elapsed = time.perf_counter() - start
+    total = sum(sum(k.values()) for k in onsets.values())
+    print(f"{len(ts)} samples ({hours:.1f} h), {len(fields)} metrics: "
+          f"{elapsed / len(ts) * 1e6:.0f} us/sample, {total} alerts = {total / hours:.2f}/h")
+    for f in fields:
+        if onsets[f]:
+            kinds = ", ".join(f"{k} {c / hours:.2f}/h" for k, c in sorted(onsets[f].items()))
+            print(f"  {f}: {kinds}")
+
+
+MAX_FALSE_PER_HOUR = 0.25
+# (field, kind, start hour, duration s, shape) planted by synthetic_series
+PLANTED = (
+    ("cpu.cores.3", KIND_STUCK, 2.0, 300, "pin"),
+    ("cpu.temp", KIND_SPIKE, 3.0, 60, "step"),
+    ("gpu.vram_used", KIND_TREND, 4.0, 5400, "ramp"),
+)
+# Samples allowed before a planted event must be flagged, by kind
+DETECT_WITHIN = {KIND_SPIKE: PERSIST + 2, KIND_STUCK: STUCK_SAMPLES + 2, KIND_TREND: 1800}
+# Samples after an event in which firing on that field is still its doing
+SETTLE = 1800
+
+
+def synthetic_series(fields, hours=8.0, seed=0):
+    """1 Hz samples: per-metric level with white and slowly correlated noise,
+    plus the PLANTED events. Returns (rows, [(field, kind, start, end)])"""
+    rng = random.Random(seed)
+    n = int(hours * 3600)
+    shapes = {}
+    events = []
+    for field, kind, hour, seconds, shape in PLANTED:
+        if field in fields:
+            start = int(hour * 3600)
+            shapes[field] = (start, start + seconds, shape)
+            events.append((field, kind, start, start + seconds))
+    state = []
+    for f in fields:
+        level = rng.uniform(10, 60)
+        # (level, white std, AR(1) std, AR coefficient, AR value)
+        state.append([level, level * rng.uniform(0.01, 0.05), level * 0.01, 0.995, 0.0])
+    rows = []
+    for i in range(n):
+        row = []
+        for f, st in zip(fields, state):
+            level, white, ar_std, phi, ar = st
+            ar = phi * ar + rng.gauss(0, ar_std * math.sqrt(1 - phi * phi))
+            st[4] = ar
+            x = level + ar + rng.gauss(0, white)
+            event = shapes.get(f)
+            if event and event[0] <= i < event[1]:
+                start, end, shape = event
+                if shape == "pin":
+                    x = 100.0
+                elif shape == "step":
+                    x += 25.0
+                elif shape == "ramp":
+                    x += (i - start) * 0.01
+            elif event and event[2] == "ramp" and i >= event[1]:
+                x += (event[1] - event[0]) * 0.01
+            if _is_percent(f):
+                x = min(100.0, max(0.0, x))
+            row.append(x)
+        rows.append(row)
+    return rows, events
+
+
+def check(hours=8.0, seed=0):
+    """Replay the synthetic series; True when every planted event is caught
+    in time and false alarms stay under MAX_FALSE_PER_HOUR"""
+    fields = [f for f in NAMES if f not in AnomalyMonitor.SKIP]
+    rows, events = synthetic_series(fields, hours, seed)
+    mon = AnomalyMonitor(fields)
+    prev = [set() for _ in fields]
+    onsets = []
+    for i, row in enumerate(rows):
+        mon.evaluate(row)
+        for j, det in enumerate(mon.detectors):
+            for kind in det.flags - prev[j]:
+                onsets.append((i, fields[j], kind))
+            prev[j] = set(det.flags)
+    ok = True
+    for field, kind, start, end in events:
+        hit = [i for i, f, k in onsets if f == field and k == kind and start <= i < end]
+        if hit and hit[0] - start <= DETECT_WITHIN[kind]:
+            print(f"  {field} {kind}: flagged after {hit[0] - start} samples")
+        else:
+            print(f"  {field} {kind}: MISSED (allowed {DETECT_WITHIN[kind]} samples)")
+            ok = False
+    false = [(i, f, k) for i, f, k in onsets
+             if not any(f == ef and es <= i < ee + SETTLE for ef, _, es, ee in events)]
+    rate = len(false) / hours
+    print(f"  {len(false)} false alarms in {hours:g} h = {rate:.2f}/h (max {MAX_FALSE_PER_HOUR}/h)")
+    for i, f, k in false[:10]:
+        print(f"    {i / 3600:.2f} h {f} {k}")
+    return ok and rate <= MAX_FALSE_PER_HOUR
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Replay anomaly detectors")
+    parser.add_argument("--replay", metavar="RING_STORE", help="Report firing rates on recorded history")
+    parser.add_argument("--check", action="store_true",
+                        help="Replay a synthetic series with planted events; exit 1 on a miss "
+                             "or too many false alarms")
+    parser.add_argument("--hours", type=float, default=8.0)
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+    if args.replay:
+        replay(args.replay)
+    elif args.check:
+        passed = check(args.hours, args.seed)
+        print("anomaly check " + ("passed" if passed else "FAILED"))
+        sys.exit(0 if passed else 1)
+    else:
+        parser.print_usage(sys.stderr)
+        sys.exit(2)
@@ -0,0 +1,340 @@
+"""Gorilla-style compressed long-term archive.
+
+Each metric is encoded on the fly into the current time block: timestamps as
+delta-of-delta in milliseconds, values by XOR with the previous value's f32
+bit pattern (the ring store and the agent wire format are f32 too, so the
+32-bit variant of the scheme loses nothing). When a block closes, its encoded
+series are appended to the archive with one sequential write, and the file is
+fsynced at most every FSYNC_INTERVAL seconds. The block still open is written
+as a short block by close(), which the monitor also reaches on SIGTERM; only
+a hard kill loses it.
+
+    block   "CYDG" u8 name length, name, f64 start, f64 end, u32 points,
+            u32 payload bytes, payload
+"""
+import math
+import os
+import struct
+import sys
+import time
+
+from registry import NAMES, reader
+
+DEFAULT_ARCHIVE_PATH = os.path.expanduser("~/.local/share/cyd-monitor/archive.gor")
+DEFAULT_BLOCK_SECONDS = 2 * 3600
+FSYNC_INTERVAL = 60.0
+
+MAGIC = b"CYDG"
+BLOCK_HEAD = struct.Struct("<4sB")
+BLOCK_META = struct.Struct("<ddII")
+F32 = struct.Struct("<f")
+U32 = struct.Struct("<I")
+
+# (prefix bits, prefix length, value bits) for delta-of-delta buckets
+DOD_BUCKETS = ((0b10, 2, 7), (0b110, 3, 9), (0b1110, 4, 12))
+
+
+def f32_bits(v):
+    return U32.unpack(F32.pack(v))[0]
+
+
+def bits_f32(b):
+    return F32.unpack(U32.pack(b))[0]
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.nbits = 0
+
+    def write(self, value, nbits):
+        self.acc = (self.acc << nbits) | (value & ((1 << nbits) - 1))
+        self.nbits += nbits
+        if self.nbits >= 64:
+            extra = self.nbits - 64
+            self.out += (self.acc >> extra).to_bytes(8, "big")
+            self.acc &= (1 << extra) - 1
+            self.nbits = extra
+
+    def getvalue(self):
+        """Flushed copy; the writer itself keeps accepting bits"""
+        tail = bytearray()
+        if self.nbits:
+            pad = (-self.nbits) % 8
+            tail = (self.acc << pad).to_bytes((self.nbits + pad) // 8, "big")
+        return bytes(self.out) + bytes(tail)
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def read(self, nbits):
+        i = self.pos >> 3
+        off = self.pos & 7
+        need = (off + nbits + 7) >> 3
+        chunk = int.from_bytes(self.data[i:i + need].ljust(need, b"\0"), "big")
+        self.pos += nbits
+        return (chunk >> (need * 8 - off - nbits)) & ((1 << nbits) - 1)
+
+
+class SeriesEncoder:
+    """Streaming Gorilla encoder for one metric within one block"""
+
+    def __init__(self):
+        self.w = BitWriter()
+        self.count = 0
+        self.start = self.end = 0.0
+
+    def add(self, ts, value):
+        w = self.w
+        t = int(round(ts * 1000))
+        bits = f32_bits(value)
+        if self.count == 0:
+            self.start = ts
+            w.write(t, 64)
+            w.write(bits, 32)
+            self.prev_t = t
+            self.prev_delta = 0
+            self.prev_bits = bits
+            self.lead = 32
+            self.trail = 0
+        else:
+            delta = t - self.prev_t
+            dod = delta - self.prev_delta
+            if dod == 0:
+                w.write(0, 1)
+            else:
+                for prefix, plen, vbits in DOD_BUCKETS:
+                    if -(1 << (vbits - 1)) <= dod < (1 << (vbits - 1)):
+                        w.write(prefix, plen)
+                        w.write(dod, vbits)
+                        break
+                else:
+                    w.write(0b1111, 4)
+                    w.write(dod, 32)
+            self.prev_t = t
+            self.prev_delta = delta
+
+            x = bits ^ self.prev_bits
+            if x == 0:
+                w.write(0, 1)
+            else:
+                lead = min(32 - x.bit_length(), 31)
+                trail = (x & -x).bit_length() - 1
+                if lead >= self.lead and trail >= self.trail:
+                    # Fits inside the previous meaningful window
+                    w.write(0b10, 2)
+                    w.write(x >> self.trail, 32 - self.lead - self.trail)
+                else:
+                    sig = 32 - lead - trail
+                    w.write(0b11, 2)
+                    w.write(lead, 5)
+                    w.write(sig - 1, 5)
+                    w.write(x >> trail, sig)
+                    self.lead, self.trail = lead, trail
+            self.prev_bits = bits
+        self.end = ts
+        self.count += 1
+
+
+def _signed(v, nbits):
+    return v - (1 << nbits) if v >= 1 << (nbits - 1) else v
+
+
+def decode_series(payload, count):
+    """Yield (ts, value) for one encoded block"""
+    if count == 0:
+        return
+    r = BitReader(payload)
+    t = r.read(64)
+    bits = r.read(32)
+    yield t / 1000.0, bits_f32(bits)
+    delta = 0
+    lead, trail = 32, 0
+    for _ in range(count - 1):
+        if r.read(1) == 0:
+            dod = 0
+        elif r.read(1) == 0:
+            dod = _signed(r.read(7), 7)
+        elif r.read(1) == 0:
+            dod = _signed(r.read(9), 9)
+        elif r.read(1) == 0:
+            dod = _signed(r.read(12), 12)
+        else:
+            dod = _signed(r.read(32), 32)
+        delta += dod
+        t += delta
+        if r.read(1) == 1:
+            if r.read(1) == 1:
+                lead = r.read(5)
+                sig = r.read(5) + 1
+                trail = 32 - lead - sig
+            bits ^= r.read(32 - lead - trail) << trail
+        yield t / 1000.0, bits_f32(bits)
+
+
+def encode_block(name, enc):
+    payload = enc.w.getvalue()
+    raw_name = name.encode()[:255]
+    return (BLOCK_HEAD.pack(MAGIC, len(raw_name)) + raw_name
+            + BLOCK_META.pack(enc.start, enc.end, enc.count, len(payload)) + payload)
+
+
+class Archiver:
+    """Sink that compresses closed time blocks into the archive file"""
+
+    def __init__(self, path=DEFAULT_ARCHIVE_PATH, fields=NAMES, block_seconds=DEFAULT_BLOCK_SECONDS):
+        self.path = path
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.block_seconds = block_seconds
+        self.encoders = None
+        self.block_start = None
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        self.fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_APPEND, 0o644)
+        self.dirty = False
+        self.next_sync = time.monotonic() + FSYNC_INTERVAL
+        print(f"Archiving {block_seconds / 3600:g}h blocks to {path}")
+
+    def publish(self, data, ts=None):
+        self.append(self.read(data), time.time() if ts is None else ts)
+
+    def append(self, values, ts):
+        # Blocks are aligned to wall-clock boundaries so restarts line up
+        block = ts - ts % self.block_seconds
+        if self.block_start != block:
+            self.close_block()
+            self.block_start = block
+            self.encoders = [SeriesEncoder() for _ in self.fields]
+        for enc, v in zip(self.encoders, values):
+            if v == v:
+                enc.add(ts, v)
+
+    def close_block(self):
+        if self.encoders:
+            chunk = bytearray()
+            for name, enc in zip(self.fields, self.encoders):
+                if enc.count:
+                    chunk += encode_block(name, enc)
+            self.encoders = None
+            if chunk:
+                os.write(self.fd, chunk)
+                self.dirty = True
+        now = time.monotonic()
+        if self.dirty and now >= self.next_sync:
+            self.sync(now)
+
+    def sync(self, now=None):
+        os.fsync(self.fd)
+        self.dirty = False
+        self.next_sync = (now or time.monotonic()) + FSYNC_INTERVAL
+
+    def close(self):
+        # The open block is archived as a short block rather than dropped
+        self.close_block()
+        if self.dirty:
+            self.sync()
+        os.close(self.fd)
+
+
+def iter_blocks(path):
+    """Yield (name, start, end, count, offset, size) without decoding payloads"""
+    with open(path, "rb") as f:
+        while True:
+            head = f.read(BLOCK_HEAD.size)
+            if len(head) < BLOCK_HEAD.size:
+                return
+            magic, name_len = BLOCK_HEAD.unpack(head)
+            if magic != MAGIC:
+                print(f"{path}: corrupt block at {f.tell() - len(head)}", file=sys.stderr)
+                return
+            name = f.read(name_len).decode(errors="replace")
+            meta = f.read(BLOCK_META.size)
+            if len(meta) < BLOCK_META.size:
+                return
+            start, end, count, size = BLOCK_META.unpack(meta)
+            offset = f.tell()
+            yield name, start, end, count, offset, size
+            f.seek(offset + size)
+
+
+def query(path, name, t0=-math.inf, t1=math.inf):
+    """Stream (ts, value) for one metric, decoding only overlapping blocks"""
+    with open(path, "rb") as f:
+        for bname, start, end, count, offset, size in iter_blocks(path):
+            if bname != name or end < t0 or start > t1:
+                continue
+            f.seek(offset)
+            payload = f.read(size)
+            if len(payload) < size:
+                return
+            for ts, v in decode_series(payload, count):
+                if t0 <= ts <= t1:
+                    yield ts, v
+
+
+def _bench(store_path):
+    """Compression ratio and throughput on traces from the ring store"""
+    from tsdb import RingReader
+    reader = RingReader(store_path)
+    total_points = total_bytes = 0
+    enc_time = dec_time = 0.0
+    worst = []
+    for name in reader.fields:
+        ts, vals = reader.range(name)
+        pts = [(t, v) for t, v in zip(ts, vals) if v == v]
+        if not pts:
+            continue
+        start = time.perf_counter()
+        enc = SeriesEncoder()
+        for t, v in pts:
+            enc.add(t, v)
+        payload = enc.w.getvalue()
+        enc_time += time.perf_counter() - start
+        start = time.perf_counter()
+        decoded = list(decode_series(payload, enc.count))
+        dec_time += time.perf_counter() - start
+        assert all(abs(a[0] - b[0]) < 1e-3 and F32.pack(a[1]) == F32.pack(b[1]) for a, b in zip(pts, decoded)), name
+        total_points += len(pts)
+        total_bytes += len(payload)
+        worst.append((len(payload) / len(pts), name))
+    if not total_points:
+        print("ring store is empty")
+        return
+    raw = total_points * 12  # f64 timestamp + f32 value per point in the ring store
+    print(f"{total_points} points, {raw} -> {total_bytes} bytes, ratio {raw / total_bytes:.1f}x "
+          f"({total_bytes * 8 / total_points:.2f} bits/point)")
+    print(f"encode {total_points / enc_time / 1e6:.2f} Mpoints/s, decode {total_points / dec_time / 1e6:.2f} Mpoints/s")
+    for bpp, name in sorted(worst, reverse=True)[:5]:
+        print(f"  {name}: {bpp * 8:.1f} bits/point")
+
+
+def main():
+    import argparse
+    parser = argparse.ArgumentParser(description="Query or benchmark the compressed archive")
+    parser.add_argument("field", nargs="?")
+    parser.add_argument("--path", default=DEFAULT_ARCHIVE_PATH)
+    parser.add_argument("--since", type=float, default=7 * 86400, help="Seconds of history (default 7 days)")
+    parser.add_argument("--bench", metavar="RING_STORE", help="Benchmark the codec on a ring store file")
+    args = parser.parse_args()
+
+    if args.bench:
+        _bench(args.bench)
+        return
+    if not args.field:
+        for name, start, end, count, _, size in iter_blocks(args.path):
+            print(f"{name} {time.strftime('%Y-%m-%d %H:%M', time.localtime(start))} {count} pts {size} B")
+        return
+    n = 0
+    lo, hi, total = math.inf, -math.inf, 0.0
+    for _, v in query(args.path, args.field, time.time() - args.since):
+        n += 1
+        lo, hi, total = min(lo, v), max(hi, v), total + v
+    print(f"{args.field}: n={n} min={lo:g} max={hi:g} avg={total / n if n else 0:g}")
+
+
+if __name__ == "__main__":
+    main()
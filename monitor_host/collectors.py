@@ -0,0 +1,793 @@
+"""Host metric collectors reading procfs/sysfs directly.
+
+Every collector takes a root prefix ("/" on a live system, a recorded or
+generated fixture tree for benchmarks) and does its discovery once: sensor
+files are located at start-up and kept open, and each tick is a pread at
+offset 0 on the cached descriptors (procfs regenerates the file on every read
+from offset 0), so the steady-state cost is one read syscall per file with no
+path lookups or directory scans.
+
+    cpu     /proc/stat, cpufreq policy*/scaling_cur_freq
+    temps   hwmon temp*_input (coretemp/k10temp/zenpower cores, else first sensor)
+    fans    hwmon fan*_input (first spinning fan)
+    rapl    powercap intel-rapl:0 energy_uj
+    gpu     NVML (module injected so benchmarks can use a mock, or imported
+            and initialised on a background thread by name); the total
+            energy counter only when an energy meter asks for it
+    mem     /proc/meminfo
+    disk    statvfs of the root
+    fs      every real mount from /proc/self/mountinfo: bytes, inodes and a
+            time-to-full forecast
+    net     /proc/net/dev
+    proto   /proc/net/snmp, /proc/net/netstat (TCP/UDP error counter rates)
+
+The /proc/stat, meminfo and net/dev parsers have native versions in the
+optional _fastproc extension (build_fastproc.sh); HostCollector uses them when
+the module is importable and native is not turned off.
+"""
+import glob
+import importlib
+import collections
+import os
+import re
+import select
+import threading
+import time
+
+try:
+    import _fastproc
+except ImportError:
+    _fastproc = None
+
+READ_CHUNK = 65536
+OCTAL_ESCAPE = re.compile(r"\\([0-7]{3})")
+
+
+class SysFile:
+    """Open-once file re-read with pread from offset 0"""
+
+    def __init__(self, path):
+        self.path = path
+        self.fd = os.open(path, os.O_RDONLY)
+
+    def read(self):
+        data = os.pread(self.fd, READ_CHUNK, 0)
+        if len(data) < READ_CHUNK:
+            return data
+        # Large /proc/stat on many-core machines
+        parts = [data]
+        offset = READ_CHUNK
+        while True:
+            chunk = os.pread(self.fd, READ_CHUNK, offset)
+            if not chunk:
+                break
+            parts.append(chunk)
+            offset += len(chunk)
+        return b"".join(parts)
+
+    def read_int(self):
+        return int(self.read())
+
+    def close(self):
+        os.close(self.fd)
+
+
+def _open(root, path):
+    try:
+        return SysFile(os.path.join(root, path.lstrip("/")))
+    except OSError:
+        return None
+
+
+class CpuCollector:
+    name = "cpu"
+
+    def __init__(self, root="/", native=False):
+        self.stat = _open(root, "/proc/stat")
+        self.native = _fastproc.CpuStat(self.stat.fd) if native and self.stat else None
+        self.prev = None
+        self.freq = [SysFile(p) for p in sorted(glob.glob(os.path.join(
+            root, "sys/devices/system/cpu/cpufreq/policy*/scaling_cur_freq")))]
+
+    @staticmethod
+    def _times(line):
+        v = [int(x) for x in line.split()[1:]]
+        # guest and guest_nice are already counted in user and nice
+        total = sum(v[:8])
+        idle = v[3] + (v[4] if len(v) > 4 else 0)
+        return total, idle
+
+    def collect(self, data):
+        cpu = data.setdefault("cpu", {})
+        if self.native:
+            load = self.native.sample()
+        else:
+            load = self._load()
+        cpu["load"] = load[0] if load else 0.0
+        cpu["cores"] = load[1:17]
+
+        freqs = []
+        for f in self.freq:
+            try:
+                freqs.append(f.read_int())
+            except (OSError, ValueError):
+                pass
+        cpu["freq"] = round(sum(freqs) / len(freqs) / 1000) if freqs else 0
+
+    def _load(self):
+        times = []
+        if self.stat:
+            for line in self.stat.read().split(b"\n"):
+                if not line.startswith(b"cpu"):
+                    break
+                times.append(self._times(line))
+        load = []
+        if self.prev and len(self.prev) == len(times):
+            for (t, i), (pt, pi) in zip(times, self.prev):
+                dt = t - pt
+                if dt <= 0:
+                    load.append(0.0)
+                    continue
+                # iowait can go backwards; clamp like _fastproc so load stays in 0..100
+                di = min(max(i - pi, 0), dt)
+                # Integer permille, half to even, exactly as _fastproc rounds
+                q, r = divmod((dt - di) * 1000, dt)
+                if 2 * r > dt or (2 * r == dt and q & 1):
+                    q += 1
+                load.append(q / 10)
+        else:
+            load = [0.0] * len(times)
+        self.prev = times
+        return load
+
+
+class HwmonCollector:
+    """Shared hwmon discovery for temperature and fan collectors"""
+
+    def __init__(self, root="/"):
+        self.chips = []
+        for chip in sorted(glob.glob(os.path.join(root, "sys/class/hwmon/hwmon*"))):
+            try:
+                with open(os.path.join(chip, "name")) as f:
+                    name = f.read().strip()
+            except OSError:
+                continue
+            self.chips.append((name, chip))
+
+    @staticmethod
+    def _label(chip, sensor):
+        try:
+            with open(os.path.join(chip, f"{sensor}_label")) as f:
+                return f.read().strip()
+        except OSError:
+            return ""
+
+    @staticmethod
+    def _inputs(chip, kind):
+        found = glob.glob(os.path.join(chip, f"{kind}*_input"))
+        return sorted(found, key=lambda p: int(os.path.basename(p)[len(kind):].split("_")[0]))
+
+
+class TempCollector(HwmonCollector):
+    name = "temps"
+    CPU_CHIPS = ("coretemp", "k10temp", "zenpower")
+
+    def __init__(self, root="/"):
+        super().__init__(root)
+        self.files = []
+        for name, chip in self.chips:
+            if name not in self.CPU_CHIPS:
+                continue
+            for path in self._inputs(chip, "temp"):
+                label = self._label(chip, os.path.basename(path)[:-len("_input")])
+                if "Core" in label or "Tctl" in label:
+                    self.files.append(SysFile(path))
+        if not self.files:
+            # Same fallback as before: the first sensor of the first chip
+            for _, chip in self.chips:
+                inputs = self._inputs(chip, "temp")
+                if inputs:
+                    self.files.append(SysFile(inputs[0]))
+                    break
+
+    def collect(self, data):
+        temps = []
+        for f in self.files:
+            try:
+                temps.append(f.read_int() / 1000)
+            except (OSError, ValueError):
+                pass
+        data.setdefault("cpu", {})["temp"] = round(sum(temps) / len(temps), 1) if temps else 0
+
+
+class FanCollector(HwmonCollector):
+    name = "fans"
+
+    def __init__(self, root="/"):
+        super().__init__(root)
+        self.files = [SysFile(p) for _, chip in self.chips for p in self._inputs(chip, "fan")]
+
+    def collect(self, data):
+        rpm = 0
+        for f in self.files:
+            try:
+                rpm = f.read_int()
+            except (OSError, ValueError):
+                continue
+            if rpm > 0:
+                break
+        data.setdefault("cpu", {})["fan"] = rpm
+
+
+class RaplCollector:
+    name = "rapl"
+    DOMAIN = "sys/class/powercap/intel-rapl/intel-rapl:0"
+
+    def __init__(self, root="/"):
+        self.energy = _open(root, os.path.join(self.DOMAIN, "energy_uj"))
+        self.max_range = 0
+        max_file = _open(root, os.path.join(self.DOMAIN, "max_energy_range_uj"))
+        if max_file:
+            self.max_range = max_file.read_int()
+            max_file.close()
+        self.prev = None
+
+    def collect(self, data):
+        watts = 0.0
+        if self.energy:
+            try:
+                energy = self.energy.read_int()
+            except (OSError, ValueError):
+                energy = None
+            now = time.monotonic()
+            if energy is not None and self.prev:
+                delta = energy - self.prev[0]
+                if delta < 0:
+                    # The counter wraps at max_energy_range_uj
+                    delta = delta + self.max_range if self.max_range else 0
+                dt = now - self.prev[1]
+                if dt > 0:
+                    watts = round(delta / 1e6 / dt, 1)
+            if energy is not None:
+                self.prev = (energy, now)
+        data.setdefault("cpu", {})["pwr"] = watts
+
+
+class GpuCollector:
+    name = "gpu"
+    RETRY_INIT = 30.0
+    EMPTY = {"gpu_load": 0, "vram_used": 0, "vram_total": 0, "vram_p": 0, "gpu_temp": 0, "gpu_pwr": 0, "gpu_fan": 0}
+
+    def __init__(self, nvml=None):
+        # A module name is imported and initialised off the main thread: NVML
+        # init takes hundreds of ms and would otherwise delay the first frame
+        self.module = nvml if isinstance(nvml, str) else None
+        self.nvml = None if self.module else nvml
+        self.handle = None
+        self.next_init = 0.0
+        self.loader = None
+        # Set by the energy meter: also read the total energy counter ("mj")
+        self.total_energy = False
+        if self.module:
+            self._start_loader()
+
+    def _start_loader(self):
+        self.loader = threading.Thread(target=self._load, name="nvml-init", daemon=True)
+        self.loader.start()
+
+    def _load(self):
+        if self.nvml is None:
+            try:
+                self.nvml = importlib.import_module(self.module)
+            except ImportError:
+                self.module = None
+                return
+        self._init()
+
+    def _init(self):
+        now = time.monotonic()
+        if now < self.next_init:
+            return False
+        try:
+            # Initialised once and kept; re-initialising per tick cost more than the queries
+            self.nvml.nvmlInit()
+            self.handle = self.nvml.nvmlDeviceGetHandleByIndex(0)
+            return True
+        except Exception:
+            self.next_init = now + self.RETRY_INIT
+            return False
+
+    def collect(self, data):
+        if self.handle is None:
+            if self.module:
+                if not self.loader.is_alive() and time.monotonic() >= self.next_init:
+                    self._start_loader()
+            elif self.nvml is not None:
+                self._init()
+            if self.handle is None:
+                data["gpu"] = dict(self.EMPTY)
+                return
+        nvml = self.nvml
+        h = self.handle
+        try:
+            util = nvml.nvmlDeviceGetUtilizationRates(h)
+            mem = nvml.nvmlDeviceGetMemoryInfo(h)
+            temp = nvml.nvmlDeviceGetTemperature(h, nvml.NVML_TEMPERATURE_GPU)
+            power = nvml.nvmlDeviceGetPowerUsage(h) / 1000.0
+        except Exception:
+            self.handle = None
+            data["gpu"] = dict(self.EMPTY)
+            return
+        try:
+            fan = nvml.nvmlDeviceGetFanSpeed(h)
+        except Exception:
+            fan = 0
+        used = mem.used / 1024**2
+        total = mem.total / 1024**2
+        data["gpu"] = {
+            "gpu_load": util.gpu,
+            "vram_used": round(used, 1),
+            "vram_total": round(total, 1),
+            "vram_p": round(used / total * 100, 1) if total else 0,
+            "gpu_temp": temp,
+            "gpu_pwr": round(power, 1),
+            "gpu_fan": fan,
+        }
+        if self.total_energy:
+            try:
+                data["gpu"]["mj"] = nvml.nvmlDeviceGetTotalEnergyConsumption(h)
+            except Exception:
+                # Pre-Volta GPUs: the energy meter integrates gpu_pwr instead
+                self.total_energy = False
+
+    def close(self):
+        if self.handle is not None:
+            try:
+                self.nvml.nvmlShutdown()
+            except Exception:
+                pass
+            self.handle = None
+
+
+class MemCollector:
+    name = "mem"
+
+    def __init__(self, root="/", native=False):
+        self.meminfo = _open(root, "/proc/meminfo")
+        self.native = native and self.meminfo is not None
+
+    def _read(self):
+        info = {}
+        if self.meminfo:
+            for line in self.meminfo.read().split(b"\n"):
+                key, _, rest = line.partition(b":")
+                if rest:
+                    info[key] = int(rest.split()[0])
+        return (info.get(b"MemTotal", 0), info.get(b"MemAvailable", info.get(b"MemFree", 0)),
+                info.get(b"SwapTotal", 0), info.get(b"SwapFree", 0))
+
+    def collect(self, data):
+        if self.native:
+            total, available, swap_total, swap_free = _fastproc.meminfo(self.meminfo.fd)
+        else:
+            total, available, swap_total, swap_free = self._read()
+        swap_used = swap_total - swap_free
+        gib = 1024 ** 2  # meminfo is in KiB
+        data["ram"] = {
+            "used": round((total - available) / gib, 1),
+            "total": round(total / gib, 1),
+            "p": round((total - available) / total * 100, 1) if total else 0,
+        }
+        data["swap"] = {
+            "used": round(swap_used / gib, 1),
+            "p": round(swap_used / swap_total * 100, 1) if swap_total else 0,
+        }
+
+
+class DiskCollector:
+    name = "disk"
+
+    def __init__(self, root="/"):
+        self.root = root
+
+    def collect(self, data):
+        try:
+            st = os.statvfs(self.root)
+        except OSError:
+            data["disk"] = {"p": 0}
+            return
+        used = (st.f_blocks - st.f_bfree) * st.f_frsize
+        avail = st.f_bavail * st.f_frsize
+        # Same definition as df: reserved blocks are not counted as free
+        data["disk"] = {"p": round(used / (used + avail) * 100, 1) if used + avail else 0}
+
+
+class _StatWorker:
+    """statvfs on its own thread, so a dead network mount cannot block a tick"""
+
+    def __init__(self, path):
+        self.path = path
+        self.request = threading.Event()
+        self.done = threading.Event()
+        self.done.set()
+        self.result = None
+        self.closed = False
+        self.thread = threading.Thread(target=self._run, name="statvfs", daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        while True:
+            self.request.wait()
+            self.request.clear()
+            if self.closed:
+                return
+            try:
+                self.result = os.statvfs(self.path)
+            except OSError as e:
+                self.result = e
+            self.done.set()
+
+    def start(self):
+        self.done.clear()
+        self.request.set()
+
+    def close(self):
+        # An idle worker is joined; one stuck in statvfs exits once the call returns
+        self.closed = True
+        self.request.set()
+        if self.done.is_set():
+            self.thread.join(timeout=1.0)
+
+
+class _Mount:
+    def __init__(self, point, path, fstype, network):
+        self.point = point
+        self.path = path
+        self.fstype = fstype
+        self.worker = _StatWorker(path) if network else None
+        self.stale = False
+        self.row = None
+        # (time, used bytes) every FORECAST_STEP seconds
+        self.history = collections.deque(maxlen=FsCollector.FORECAST_SAMPLES)
+
+    def forecast(self, now, used, avail):
+        """Hours until full from a least-squares fit of used bytes, -1 if not filling"""
+        h = self.history
+        if not h or now - h[-1][0] >= FsCollector.FORECAST_STEP:
+            h.append((now, used))
+        if len(h) < FsCollector.FORECAST_MIN:
+            return -1
+        t0 = h[0][0]
+        n = len(h)
+        st = su = stt = stu = 0.0
+        for t, u in h:
+            t -= t0
+            st += t
+            su += u
+            stt += t * t
+            stu += t * u
+        den = n * stt - st * st
+        if den <= 0:
+            return -1
+        slope = (n * stu - st * su) / den
+        if slope <= 0:
+            return -1
+        return round(min(avail / slope / 3600, FsCollector.MAX_HOURS), 1)
+
+
+class FsCollector:
+    """Capacity of every real filesystem, busiest first"""
+    name = "fs"
+    # Mounted from a block device, or one of these
+    NETWORK = {"nfs", "nfs4", "cifs", "smb3", "smbfs", "ceph", "glusterfs", "9p", "afs"}
+    SKIP = {"squashfs", "iso9660", "udf"}
+    STAT_TIMEOUT = 0.2
+    FORECAST_STEP = 30.0
+    FORECAST_SAMPLES = 240
+    FORECAST_MIN = 10
+    MAX_HOURS = 9999
+    MAX_ROWS = 5
+
+    def __init__(self, root="/"):
+        self.root = root
+        self.mountinfo = _open(root, "/proc/self/mountinfo")
+        self.poller = None
+        if self.mountinfo:
+            # The kernel flags POLLPRI on this file when the mount table changes
+            self.poller = select.poll()
+            self.poller.register(self.mountinfo.fd, select.POLLPRI)
+        # (device, mount point) -> _Mount
+        self.mounts = {}
+        self._load()
+
+    @staticmethod
+    def _unescape(field):
+        # Spaces, tabs, newlines and backslashes are octal-escaped
+        return OCTAL_ESCAPE.sub(lambda m: chr(int(m.group(1), 8)), field)
+
+    def _load(self):
+        table = {}
+        if self.mountinfo:
+            for line in self.mountinfo.read().decode(errors="replace").splitlines():
+                pre, sep, post = line.partition(" - ")
+                pre = pre.split()
+                post = post.split()
+                if not sep or len(pre) < 5 or len(post) < 2:
+                    continue
+                dev, point = pre[2], self._unescape(pre[4])
+                fstype, source = post[0], post[1]
+                network = fstype in self.NETWORK or fstype.startswith("fuse.")
+                if fstype in self.SKIP or not (source.startswith("/") or network):
+                    continue
+                # Bind mounts repeat a filesystem; keep its shortest mount point
+                if dev in table and len(table[dev][0]) <= len(point):
+                    continue
+                table[dev] = (point, fstype, network)
+        # One _Mount (and at most one statvfs worker) per device, kept across
+        # reloads while its (device, mount point) and type stay the same
+        old = dict(self.mounts)
+        mounts = {}
+        for dev, (point, fstype, network) in table.items():
+            m = old.pop((dev, point), None)
+            if m is not None and m.fstype != fstype:
+                old[(dev, point)] = m
+                m = None
+            if m is None:
+                m = _Mount(point, os.path.join(self.root, point.lstrip("/")), fstype, network)
+            mounts[(dev, point)] = m
+        for m in old.values():
+            if m.worker:
+                m.worker.close()
+        self.mounts = mounts
+
+    def collect(self, data):
+        if self.poller and self.poller.poll(0):
+            self._load()
+        now = time.monotonic()
+        remote = []
+        for m in self.mounts.values():
+            if not m.worker:
+                continue
+            if m.worker.done.is_set():
+                m.worker.start()
+                remote.append(m)
+            else:
+                # Still stuck from an earlier tick: not asked again, not waited for
+                m.stale = True
+                if m.row:
+                    m.row["st"] = 1
+        for m in self.mounts.values():
+            if not m.worker:
+                try:
+                    self._update(m, os.statvfs(m.path), now)
+                except OSError:
+                    m.row = None
+        deadline = time.monotonic() + self.STAT_TIMEOUT
+        for m in remote:
+            m.stale = not m.worker.done.wait(max(0.0, deadline - time.monotonic()))
+            if m.stale:
+                if m.row:
+                    m.row["st"] = 1
+            elif isinstance(m.worker.result, OSError):
+                m.row = None
+            else:
+                self._update(m, m.worker.result, now)
+        rows = sorted((m.row for m in self.mounts.values() if m.row), key=lambda r: -r["p"])
+        data["fs"] = rows[:self.MAX_ROWS]
+
+    def _update(self, m, st, now):
+        if not st.f_blocks:
+            m.row = None
+            return
+        used = (st.f_blocks - st.f_bfree) * st.f_frsize
+        avail = st.f_bavail * st.f_frsize
+        inodes_used = st.f_files - st.f_ffree
+        gib = 1024 ** 3
+        m.row = {
+            "m": m.point if len(m.point) <= 12 else "~" + m.point[-11:],
+            "p": round(used / (used + avail) * 100, 1) if used + avail else 0,
+            "ip": round(inodes_used / st.f_files * 100, 1) if st.f_files else 0,
+            "u": round(used / gib, 1),
+            "t": round((used + avail) / gib, 1),
+            "ttf": m.forecast(now, used, avail),
+            "st": 0,
+        }
+
+    def close(self):
+        for m in self.mounts.values():
+            if m.worker:
+                m.worker.close()
+        if self.mountinfo:
+            self.mountinfo.close()
+
+
+class NetCollector:
+    name = "net"
+
+    def __init__(self, root="/", native=False):
+        self.dev = _open(root, "/proc/net/dev")
+        self.native = native and self.dev is not None
+
+    def collect(self, data):
+        recv = sent = 0
+        if self.native:
+            recv, sent = _fastproc.net_dev(self.dev.fd)
+        elif self.dev:
+            for line in self.dev.read().split(b"\n")[2:]:
+                _, _, fields = line.partition(b":")
+                v = fields.split()
+                if len(v) >= 9:
+                    recv += int(v[0])
+                    sent += int(v[8])
+        data["net"] = {"sent": round(sent / 1024**2, 1), "recv": round(recv / 1024**2, 1)}
+
+
+class _PairFile:
+    """/proc/net/snmp-style file: "Sec: name name ..." followed by "Sec: v v ..."
+
+    The header lines are parsed once into (value line, column) per wanted
+    counter; a tick only compares the header lines it relies on and splits
+    the value lines it needs. A changed layout (new kernel counters) rebuilds
+    the index.
+    """
+
+    def __init__(self, root, path, wanted):
+        self.file = _open(root, path)
+        self.wanted = wanted
+        self.index = None
+        self.headers = {}
+
+    def _build(self, lines):
+        pos = {}
+        for i in range(len(lines) - 1):
+            section, colon, names = lines[i].partition(b":")
+            if not colon or not lines[i + 1].startswith(section + b":"):
+                continue
+            names = names.split()
+            if not names or names[0].lstrip(b"-").isdigit():
+                continue
+            for col, name in enumerate(names, 1):
+                pos[(section, name)] = (i + 1, col, i)
+        self.index = [pos.get(w) for w in self.wanted]
+        self.headers = {p[2]: lines[p[2]] for p in self.index if p}
+
+    def read(self):
+        """Wanted counters in order, None for ones this kernel lacks"""
+        if not self.file:
+            return [None] * len(self.wanted)
+        lines = self.file.read().split(b"\n")
+        n = len(lines)
+        if self.index is None or any(h >= n or lines[h] != text for h, text in self.headers.items()):
+            self._build(lines)
+        rows = {}
+        out = []
+        for p in self.index:
+            if p is None:
+                out.append(None)
+                continue
+            row = rows.get(p[0])
+            if row is None:
+                row = rows[p[0]] = lines[p[0]].split()
+            out.append(int(row[p[1]]) if p[1] < len(row) else None)
+        return out
+
+    def close(self):
+        if self.file:
+            self.file.close()
+
+
+class ProtoCollector:
+    """Rates of the TCP/UDP counters that throughput does not show"""
+    name = "proto"
+    SNMP = ((b"Tcp", b"RetransSegs", "retr"), (b"Tcp", b"OutSegs", None),
+            (b"Tcp", b"EstabResets", "rst"), (b"Tcp", b"AttemptFails", "afail"),
+            (b"Tcp", b"InErrs", "inerr"), (b"Udp", b"InErrors", "uerr"),
+            (b"Udp", b"RcvbufErrors", "ubuf"), (b"Udp", b"NoPorts", "noport"))
+    NETSTAT = ((b"TcpExt", b"ListenOverflows", "lovf"), (b"TcpExt", b"ListenDrops", "ldrop"),
+               (b"TcpExt", b"TCPTimeouts", "tmo"))
+
+    def __init__(self, root="/"):
+        self.snmp = _PairFile(root, "/proc/net/snmp",
+                              [(s, n) for s, n, _ in self.SNMP] + [(b"Tcp", b"CurrEstab")])
+        self.netstat = _PairFile(root, "/proc/net/netstat", [(s, n) for s, n, _ in self.NETSTAT])
+        self.keys = [k for _, _, k in self.SNMP + self.NETSTAT]
+        self.prev = None
+
+    def collect(self, data):
+        now = time.monotonic()
+        snmp = self.snmp.read()
+        estab = snmp.pop()
+        values = snmp + self.netstat.read()
+        rates = [0.0] * len(values)
+        if self.prev:
+            dt = now - self.prev[1]
+            for i, (v, p) in enumerate(zip(values, self.prev[0])):
+                # Counters only go backwards on a wrap or reset: report nothing
+                if v is not None and p is not None and v >= p and dt > 0:
+                    rates[i] = (v - p) / dt
+        self.prev = (values, now)
+        out = {k: round(r, 2) for k, r in zip(self.keys, rates) if k}
+        out_segs = rates[1]
+        out["retr_p"] = round(rates[0] / out_segs * 100, 2) if out_segs else 0.0
+        out["estab"] = estab or 0
+        data["proto"] = out
+
+    def close(self):
+        self.snmp.close()
+        self.netstat.close()
+
+
+class HostCollector:
+    """Runs every collector in frame order and builds the stats dict
+
+    Each collector has a stride (run every Nth tick, 0 = disabled) that the
+    overhead governor can raise; skipped collectors keep their last values in
+    the frame. CPU time per run is tracked per collector for the same reason.
+    A stride set by the operator (control socket) is held: the governor leaves
+    that collector alone.
+    """
+    COST_ALPHA = 0.2
+    # Delta-based collectors sampled this long apart already give usable rates
+    PRIME_INTERVAL = 0.1
+
+    def __init__(self, root="/", nvml=None, native=True):
+        native = native and _fastproc is not None
+        self.native = native
+        self.collectors = [
+            CpuCollector(root, native), TempCollector(root), RaplCollector(root), FanCollector(root),
+            MemCollector(root, native), GpuCollector(nvml), DiskCollector(root), NetCollector(root, native),
+            ProtoCollector(root), FsCollector(root),
+        ]
+        self.stride = [1] * len(self.collectors)
+        self.held = set()
+        self.cost = [0.0] * len(self.collectors)
+        # CPU seconds per collector since the governor last looked
+        self.spent = [0.0] * len(self.collectors)
+        self.ticks = 0
+        self.last = {}
+        self.prime()
+
+    def prime(self):
+        """Take the first reading of every counter-based collector now, so the
+        first real frame reports rates instead of zeros"""
+        for c in self.collectors:
+            if c.name in ("cpu", "rapl", "proto"):
+                c.collect(self.last)
+        self.ready_at = time.monotonic() + self.PRIME_INTERVAL
+
+    def index(self, name):
+        for i, c in enumerate(self.collectors):
+            if c.name == name:
+                return i
+        raise ValueError(f"no collector {name!r}")
+
+    def hold(self, name, stride):
+        """Operator-set stride (0 = disabled); None hands it back to the governor"""
+        i = self.index(name)
+        if stride is None:
+            self.held.discard(i)
+            self.stride[i] = 1
+        else:
+            self.held.add(i)
+            self.stride[i] = stride
+
+    def collect(self):
+        clock = time.process_time
+        last = self.last
+        for i, c in enumerate(self.collectors):
+            stride = self.stride[i]
+            if stride == 0 or self.ticks % stride:
+                continue
+            start = clock()
+            c.collect(last)
+            spent = clock() - start
+            self.cost[i] += self.COST_ALPHA * (spent - self.cost[i])
+            self.spent[i] += spent
+        self.ticks += 1
+        # Sources add their own keys to the frame, so hand out a copy
+        return {k: v.copy() for k, v in last.items()}
+
+    def close(self):
+        for c in self.collectors:
+            if hasattr(c, "close"):
+                c.close()
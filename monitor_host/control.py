@@ -0,0 +1,321 @@
+"""Local control socket: reconfigure a running monitor without restarting it.
+
+One command per line on a Unix stream socket, one JSON reply line each:
+
+    stats                        link, tick cost, latency and per-collector state
+    interval SECONDS             frame interval
+    interval NAME SECONDS        how often collector or sampler NAME runs
+                                 (collectors: rounded to whole ticks)
+    enable NAME | disable NAME   turn a collector, source or sampler on or off
+                                 (statsd, probes, logs, energy, anomaly, tails,
+                                 cluster, watch; not the per-tick alerts)
+    auto NAME                    hand it back to the overhead governor
+    baud RATE                    switch the serial link rate in place
+    port PATH|auto               reconnect on another port
+    protocol NAME                wire encoding of stats frames
+    help
+
+The socket is served from the main loop itself: the loop's idle wait selects
+on the control descriptors, so a command is answered as soon as it arrives and
+needs no locking. Changes take effect at the next tick; only "port" drops the
+serial connection. Counter state in the collectors and sources is kept. The
+frame interval is fixed while a ring store is open, since its capacity is
+counted in samples. A command that fails is answered with its error. The
+socket is created mode 0600.
+
+    python3 control.py stats
+    python3 control.py interval 0.25
+    python3 control.py disable fs
+"""
+import errno
+import json
+import os
+import selectors
+import socket
+import stat
+import sys
+import time
+
+DEFAULT_CONTROL_PATH = os.path.join(os.environ.get("XDG_RUNTIME_DIR") or "/tmp", "cyd-monitor.sock")
+MAX_LINE = 1024
+MAX_CLIENTS = 8
+MIN_INTERVAL = 0.01
+
+
+def remove_stale(path, kind=socket.SOCK_STREAM):
+    """Unlink a socket file left by a crashed monitor, but not a live socket
+    and never a file that is not a socket"""
+    try:
+        st = os.stat(path)
+    except FileNotFoundError:
+        return
+    if not stat.S_ISSOCK(st.st_mode):
+        raise OSError(errno.EEXIST, f"{path}: exists and is not a socket")
+    probe = socket.socket(socket.AF_UNIX, kind)
+    try:
+        probe.connect(path)
+    except (ConnectionRefusedError, FileNotFoundError):
+        os.unlink(path)
+        return
+    finally:
+        probe.close()
+    raise OSError(errno.EADDRINUSE, f"{path}: another monitor is listening")
+
+
+class ControlServer:
+    def __init__(self, path, manager, host, governor=None):
+        self.path = path
+        self.manager = manager
+        self.host = host
+        self.governor = governor
+        self.started = time.monotonic()
+        remove_stale(path)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        old = os.umask(0o177)
+        try:
+            self.sock.bind(path)
+        finally:
+            os.umask(old)
+        self.sock.listen(MAX_CLIENTS)
+        self.sock.setblocking(False)
+        self.sel = selectors.DefaultSelector()
+        self.sel.register(self.sock, selectors.EVENT_READ)
+        self.clients = {}
+        self.commands = {
+            "stats": self.cmd_stats, "interval": self.cmd_interval,
+            "enable": self.cmd_enable, "disable": self.cmd_disable, "auto": self.cmd_auto,
+            "baud": self.cmd_baud, "port": self.cmd_port, "protocol": self.cmd_protocol,
+            "help": self.cmd_help,
+        }
+        print(f"Control socket at {path}")
+
+    def wait(self, timeout, wake=None):
+        """Sleep up to timeout, serving commands that arrive meanwhile; also
+        returns early when the descriptor `wake` becomes readable"""
+        if wake is not None:
+            self.sel.register(wake, selectors.EVENT_READ)
+        try:
+            for key, _ in self.sel.select(timeout):
+                if key.fileobj is self.sock:
+                    self._accept()
+                elif key.fileobj is not wake:
+                    self._read(key.fileobj)
+        finally:
+            if wake is not None:
+                self.sel.unregister(wake)
+
+    def _accept(self):
+        try:
+            conn, _ = self.sock.accept()
+        except BlockingIOError:
+            return
+        if len(self.clients) >= MAX_CLIENTS:
+            conn.close()
+            return
+        conn.setblocking(False)
+        self.clients[conn] = b""
+        self.sel.register(conn, selectors.EVENT_READ)
+
+    def _drop(self, conn):
+        self.sel.unregister(conn)
+        del self.clients[conn]
+        conn.close()
+
+    def _read(self, conn):
+        try:
+            chunk = conn.recv(MAX_LINE)
+        except BlockingIOError:
+            return
+        except OSError:
+            chunk = b""
+        if not chunk:
+            self._drop(conn)
+            return
+        buf = self.clients[conn] + chunk
+        while b"\n" in buf:
+            line, buf = buf.split(b"\n", 1)
+            line = line.decode(errors="replace").strip()
+            if not line:
+                continue
+            reply = (json.dumps(self.execute(line)) + "\n").encode()
+            try:
+                conn.sendall(reply)
+            except OSError:
+                self._drop(conn)
+                return
+        if len(buf) > MAX_LINE:
+            self._drop(conn)
+            return
+        self.clients[conn] = buf
+
+    def execute(self, line):
+        name, *args = line.split()
+        handler = self.commands.get(name)
+        if handler is None:
+            return {"ok": False, "error": f"unknown command {name!r} (try help)"}
+        try:
+            reply = handler(*args)
+        except (TypeError, ValueError) as e:
+            return {"ok": False, "error": str(e)}
+        except Exception as e:
+            # A failing command (a sink's OSError ...) must not take the loop down
+            print(f"Control: {line} failed: {e!r}", file=sys.stderr)
+            return {"ok": False, "error": f"{type(e).__name__}: {e}"}
+        print(f"Control: {line}")
+        return {"ok": True, **(reply or {})}
+
+    def _collector_rows(self):
+        host = self.host
+        interval = self.manager.interval
+        rows = []
+        for i, c in enumerate(host.collectors):
+            stride = host.stride[i]
+            rows.append({"name": c.name, "stride": stride, "every": round(stride * interval, 3),
+                         "held": i in host.held, "cost_us": round(host.cost[i] * 1e6, 1)})
+        return rows
+
+    def cmd_stats(self):
+        m = self.manager
+        now = time.monotonic()
+        out = {
+            "uptime": round(now - self.started, 1),
+            "port": m.port, "connected": m.connected, "baud": m.baud, "protocol": m.protocol,
+            "interval": m.interval, "frames": m.latency.frame_id,
+            "latency_ms": m.latency.percentiles(now),
+            "collectors": self._collector_rows(),
+            "samplers": [{"name": getattr(s, "name", type(s).__name__), "interval": s.interval}
+                         for s in m.samplers],
+            "sources": [getattr(s, "name", type(s).__name__) for s in m.sources],
+            "off": sorted({getattr(s, "name", type(s).__name__) for s in m.off}),
+            "sinks": [type(s).__name__ for s in m.sinks],
+        }
+        if m.clock.pings:
+            out["rtt_ms"] = round(min(m.clock.pings)[0] / 1000, 2)
+        if self.governor is not None:
+            g = self.governor
+            out["overhead_pct"] = round(g.overhead, 3)
+            out["tick_us"] = round(g.tick_us)
+            out["budget_pct"] = g.budget
+            out["stages"] = [{"name": st.name, "stride": st.stride, "pct": round(g.shares.get(("stage", obj), 0.0), 3)}
+                             for obj, st in g.stages.items()]
+        return out
+
+    def cmd_interval(self, *args):
+        if len(args) == 1:
+            seconds = float(args[0])
+            if seconds < MIN_INTERVAL:
+                raise ValueError(f"interval below {MIN_INTERVAL}s")
+            from tsdb import RingStore
+            for sink in self.manager.sinks:
+                # Its capacity is sized in samples of the start-up interval
+                if isinstance(sink, RingStore) and seconds != sink.interval:
+                    raise ValueError(f"the ring store is sized for {sink.interval}s samples; "
+                                     f"restart with --interval to change it")
+            self.manager.set_interval(seconds)
+            return {"interval": seconds}
+        name, seconds = args
+        seconds = float(seconds)
+        for sampler in self.manager.samplers:
+            if getattr(sampler, "name", None) == name:
+                sampler.interval = max(MIN_INTERVAL, seconds)
+                sampler.next_due = min(sampler.next_due, time.monotonic() + sampler.interval)
+                return {"name": name, "interval": sampler.interval}
+        stride = max(1, round(seconds / self.manager.interval))
+        self.host.hold(name, stride)
+        return {"name": name, "stride": stride, "every": round(stride * self.manager.interval, 3)}
+
+    def _parts(self, name):
+        """Sources and samplers called NAME (a watch target is both)"""
+        m = self.manager
+        parts = []
+        for obj in m.sources + m.samplers:
+            if getattr(obj, "name", None) == name and obj not in parts:
+                parts.append(obj)
+        if not parts and not any(c.name == name for c in self.host.collectors):
+            raise ValueError(f"no collector, source or sampler {name!r}")
+        return parts
+
+    def cmd_enable(self, name):
+        parts = self._parts(name)
+        if not parts:
+            self.host.hold(name, 1)
+            return
+        for obj in parts:
+            self.manager.off.discard(obj)
+            if hasattr(obj, "next_due"):
+                obj.next_due = time.monotonic()
+
+    def cmd_disable(self, name):
+        parts = self._parts(name)
+        if not parts:
+            self.host.hold(name, 0)
+            return
+        for obj in parts:
+            if getattr(obj, "throttle", True) is False:
+                raise ValueError(f"{name} runs every tick and cannot be disabled")
+        self.manager.off.update(parts)
+
+    def cmd_auto(self, name):
+        parts = self._parts(name)
+        if not parts:
+            self.host.hold(name, None)
+            return
+        self.cmd_enable(name)
+
+    def cmd_baud(self, rate):
+        rate = int(rate)
+        if not 9600 <= rate <= 2000000:
+            raise ValueError("baud outside 9600..2000000")
+        self.manager.want_baud = rate
+        return {"baud": rate, "now": self.manager.baud}
+
+    def cmd_port(self, path):
+        self.manager.set_port(None if path == "auto" else path)
+
+    def cmd_protocol(self, name):
+        if name not in self.manager.PROTOCOLS:
+            raise ValueError(f"protocol {name!r}: one of {', '.join(self.manager.PROTOCOLS)}")
+        self.manager.protocol = name
+
+    def cmd_help(self):
+        return {"commands": sorted(self.commands)}
+
+    def close(self):
+        for conn in list(self.clients):
+            self._drop(conn)
+        self.sel.close()
+        self.sock.close()
+        try:
+            os.unlink(self.path)
+        except OSError:
+            pass
+
+
+def request(path, line, timeout=5.0):
+    """Send one command to a running monitor and return its reply"""
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.settimeout(timeout)
+        sock.connect(path)
+        sock.sendall(line.encode() + b"\n")
+        buf = b""
+        while not buf.endswith(b"\n"):
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            buf += chunk
+    return json.loads(buf)
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Send a command to a running cyd-monitor")
+    parser.add_argument("--socket", default=DEFAULT_CONTROL_PATH)
+    parser.add_argument("command", nargs="+")
+    args = parser.parse_args()
+    try:
+        reply = request(args.socket, " ".join(args.command))
+    except OSError as e:
+        print(f"{args.socket}: {e}", file=sys.stderr)
+        sys.exit(1)
+    print(json.dumps(reply, indent=2))
+    sys.exit(0 if reply.get("ok") else 1)
@@ -0,0 +1,293 @@
+"""Energy accounting: joules per domain from the hardware counters.
+
+    cpu     RAPL package zones (intel-rapl:N, summed over sockets; AMD exposes
+            the same interface)
+    dram    RAPL dram subzones, where present
+    gpu     NVML total energy (mJ since driver load, Volta and newer); older
+            GPUs fall back to integrating the sampled power
+
+RAPL counters wrap at max_energy_range_uj and the NVML counter restarts with
+the driver; a counter that goes backwards adds the wrapped remainder (RAPL) or
+nothing (NVML) instead of a negative amount. The RAPL psys zone covers the
+whole platform and would double count, so it is left out.
+
+Totals and the per-minute ring behind the rolling windows are saved to a JSON
+state file every SAVE_INTERVAL seconds and on exit (written to a temporary
+file and renamed), so they carry across restarts. Energy used while the monitor
+is not running is not counted. The frame carries
+"en": {"d": [[name, W, Wh 1 h, Wh 24 h], ...], "h": Wh 1 h, "day": Wh 24 h,
+"kwh": lifetime}. The metrics endpoint exports cyd_energy_joules_total
+counters, so the energy of a job is increase() over its run.
+"""
+import glob
+import json
+import os
+import sys
+import time
+
+from collectors import _open
+
+DEFAULT_ENERGY_PATH = os.path.expanduser("~/.local/share/cyd-monitor/energy.json")
+SAVE_INTERVAL = 60.0
+MINUTES = 1440
+HOUR = 60
+WH = 3600.0
+
+
+class _RaplDomain:
+    def __init__(self, name, zones, root):
+        self.name = name
+        self.files = []
+        for zone in zones:
+            f = _open(root, os.path.join(zone, "energy_uj"))
+            if f is None:
+                continue
+            max_file = _open(root, os.path.join(zone, "max_energy_range_uj"))
+            max_range = 0
+            if max_file:
+                max_range = max_file.read_int()
+                max_file.close()
+            self.files.append([f, max_range, None])
+
+    def joules(self):
+        """Energy since the previous call"""
+        total = 0
+        for entry in self.files:
+            f, max_range, prev = entry
+            try:
+                now = f.read_int()
+            except (OSError, ValueError):
+                continue
+            if prev is not None:
+                delta = now - prev
+                if delta < 0:
+                    delta = delta + max_range if max_range else 0
+                total += delta
+            entry[2] = now
+        return total / 1e6
+
+    def close(self):
+        for f, _, _ in self.files:
+            f.close()
+
+
+def _rapl_domains(root):
+    base = os.path.join(root, "sys/class/powercap/intel-rapl")
+    packages, dram = [], []
+    for zone in sorted(glob.glob(os.path.join(base, "intel-rapl:*")) +
+                       glob.glob(os.path.join(base, "intel-rapl:*/intel-rapl:*:*"))):
+        try:
+            with open(os.path.join(zone, "name")) as f:
+                name = f.read().strip()
+        except OSError:
+            continue
+        rel = os.path.relpath(zone, root)
+        if name.startswith("package"):
+            packages.append(rel)
+        elif name == "dram":
+            dram.append(rel)
+    domains = [_RaplDomain("cpu", packages, root), _RaplDomain("dram", dram, root)]
+    return [d for d in domains if d.files]
+
+
+class EnergyMeter:
+    """Source integrating energy per domain with persisted totals"""
+    name = "energy"
+
+    def __init__(self, path=DEFAULT_ENERGY_PATH, host=None, metrics=None, root="/"):
+        self.path = path
+        self.metrics = metrics
+        self.rapl = _rapl_domains(root)
+        self.names = [d.name for d in self.rapl] + ["gpu"]
+        if host is not None:
+            for c in host.collectors:
+                if c.name == "gpu":
+                    c.total_energy = True
+        self.totals = {name: 0.0 for name in self.names}
+        self.minutes = {name: [0.0] * MINUTES for name in self.names}
+        self.stamps = [0] * MINUTES
+        self.closed = {name: (0.0, 0.0) for name in self.names}
+        self.gpu_prev = None
+        self.prev_ts = None
+        self.watts = {name: 0.0 for name in self.names}
+        self.since = time.time()
+        self._load()
+        self.next_save = time.monotonic() + SAVE_INTERVAL
+        if not self.rapl:
+            print("No readable RAPL counters (energy_uj is root-only on many kernels); "
+                  "counting GPU energy only", file=sys.stderr)
+
+    def _load(self):
+        try:
+            with open(self.path) as f:
+                state = json.load(f)
+        except (OSError, ValueError):
+            return
+        self.since = state.get("since", self.since)
+        for name, joules in state.get("totals", {}).items():
+            if name in self.totals:
+                self.totals[name] = joules
+        # Minute buckets are keyed by wall-clock minute so they line up again
+        minute = int(time.time() // 60)
+        for key, ring in state.get("minutes", {}).items():
+            if key not in self.minutes:
+                continue
+            for m, joules in ring:
+                if minute - m < MINUTES:
+                    self.minutes[key][m % MINUTES] = joules
+                    self.stamps[m % MINUTES] = m
+        self._close_minutes(minute)
+        print(f"Energy totals restored from {self.path} "
+              f"({sum(self.totals.values()) / WH / 1000:.2f} kWh since {time.strftime('%Y-%m-%d', time.localtime(self.since))})")
+
+    def save(self):
+        minute = int(time.time() // 60)
+        state = {
+            "since": self.since,
+            "totals": {k: round(v, 3) for k, v in self.totals.items()},
+            "minutes": {k: [[s, round(ring[s % MINUTES], 3)] for s in sorted(set(self.stamps))
+                            if s and minute - s < MINUTES and ring[s % MINUTES]]
+                        for k, ring in self.minutes.items()},
+        }
+        os.makedirs(os.path.dirname(self.path) or ".", exist_ok=True)
+        tmp = self.path + ".tmp"
+        with open(tmp, "w") as f:
+            json.dump(state, f)
+        os.replace(tmp, self.path)
+
+    def _close_minutes(self, minute):
+        """Window sums over finished minutes, recomputed once per minute"""
+        for name, ring in self.minutes.items():
+            hour = day = 0.0
+            for i, s in enumerate(self.stamps):
+                age = minute - s
+                if 0 < age < MINUTES:
+                    day += ring[i]
+                    if age < HOUR:
+                        hour += ring[i]
+            self.closed[name] = (hour, day)
+
+    def _gpu_joules(self, data, dt):
+        gpu = data.get("gpu", {})
+        mj = gpu.pop("mj", None)
+        prev, self.gpu_prev = self.gpu_prev, mj
+        if mj is not None and prev is not None and mj >= prev:
+            return (mj - prev) / 1000
+        # No counter, the first reading after a tick without it (a delta
+        # against the older one would count the gap twice) or a driver
+        # restart: integrate power for this tick
+        return gpu.get("gpu_pwr", 0) * dt
+
+    def contribute(self, data):
+        now = time.monotonic()
+        dt = now - self.prev_ts if self.prev_ts is not None else 0.0
+        self.prev_ts = now
+        minute = int(time.time() // 60)
+        slot = minute % MINUTES
+        if self.stamps[slot] != minute:
+            self.stamps[slot] = minute
+            for ring in self.minutes.values():
+                ring[slot] = 0.0
+            self._close_minutes(minute)
+        joules = [d.joules() for d in self.rapl] + [self._gpu_joules(data, dt)]
+        rows = []
+        hour_total = day_total = 0.0
+        for name, j in zip(self.names, joules):
+            self.totals[name] += j
+            self.minutes[name][slot] += j
+            if dt > 0:
+                self.watts[name] = j / dt
+            hour, day = self.closed[name]
+            hour = (hour + self.minutes[name][slot]) / WH
+            day = (day + self.minutes[name][slot]) / WH
+            hour_total += hour
+            day_total += day
+            rows.append([name, round(self.watts[name], 1), round(hour, 2), round(day, 2)])
+        data["en"] = {"d": rows, "h": round(hour_total, 2), "day": round(day_total, 2),
+                      "kwh": round(sum(self.totals.values()) / WH / 1000, 3)}
+        if self.metrics is not None:
+            self._export(rows)
+        if now >= self.next_save:
+            self.next_save = now + SAVE_INTERVAL
+            self.save()
+
+    def _export(self, rows):
+        set_extra = self.metrics.set_extra
+        for name, _, hour, day in rows:
+            labels = f'{{domain="{name}"}}'
+            set_extra("cyd_energy_joules_total", round(self.totals[name], 3), labels, kind="counter")
+            set_extra("cyd_energy_wh", hour, f'{{domain="{name}",window="1h"}}')
+            set_extra("cyd_energy_wh", day, f'{{domain="{name}",window="24h"}}')
+
+    def close(self):
+        self.save()
+        for d in self.rapl:
+            d.close()
+
+
+if __name__ == "__main__":
+    # Wraparound and restart check against a generated powercap tree
+    import tempfile
+    root = tempfile.mkdtemp(prefix="cyd-energy-")
+    zones = {"intel-rapl:0": "package-0", "intel-rapl:0/intel-rapl:0:0": "core",
+             "intel-rapl:0/intel-rapl:0:1": "dram", "intel-rapl:1": "psys"}
+    MAX_RANGE = 262143328850
+
+    def write(zone, name, value):
+        path = os.path.join(root, "sys/class/powercap/intel-rapl", zone)
+        os.makedirs(path, exist_ok=True)
+        with open(os.path.join(path, name), "w") as f:
+            f.write(f"{value}\n")
+
+    def set_counters(package_uj, dram_uj):
+        write("intel-rapl:0", "energy_uj", package_uj)
+        write("intel-rapl:0/intel-rapl:0:1", "energy_uj", dram_uj)
+        write("intel-rapl:0/intel-rapl:0:0", "energy_uj", 0)
+        write("intel-rapl:1", "energy_uj", 0)
+
+    for zone, name in zones.items():
+        write(zone, "name", name)
+        write(zone, "max_energy_range_uj", MAX_RANGE)
+    state = os.path.join(root, "energy.json")
+    set_counters(MAX_RANGE - 5_000_000, 1_000_000)
+    meter = EnergyMeter(state, root=root)
+    print("domains:", meter.names)
+    # core is inside the package; psys overlaps everything and is left out
+    assert meter.names == ["cpu", "dram", "gpu"], meter.names
+    frame = {"gpu": {"gpu_pwr": 0}}
+    meter.contribute(frame)
+    # 5 J before the wrap + 15 J after it; dram +2 J
+    set_counters(15_000_000, 3_000_000)
+    frame = {"gpu": {"gpu_pwr": 0, "mj": 1_000_000}}
+    meter.contribute(frame)
+    frame = {"gpu": {"gpu_pwr": 0, "mj": 1_036_000}}
+    meter.contribute(frame)
+    print("after wrap:", {k: round(v, 3) for k, v in meter.totals.items()})
+    assert {k: round(v, 3) for k, v in meter.totals.items()} == {"cpu": 20.0, "dram": 2.0, "gpu": 36.0}
+
+    def gpu_tick(watts, mj=None, dt=1.0):
+        meter.prev_ts = time.monotonic() - dt
+        frame = {"gpu": {"gpu_pwr": watts}}
+        if mj is not None:
+            frame["gpu"]["mj"] = mj
+        before = meter.totals["gpu"]
+        meter.contribute(frame)
+        return meter.totals["gpu"] - before
+
+    # The NVML counter drops out for a tick: power is integrated instead,
+    # and the first reading back is not a delta across the gap
+    assert abs(gpu_tick(100, dt=2.0) - 200) < 0.5
+    assert abs(gpu_tick(100, mj=2_000_000) - 100) < 0.5
+    assert gpu_tick(100, mj=2_010_000) == 10.0
+    totals = dict(meter.totals)
+    meter.close()
+    restored = EnergyMeter(state, root=root)
+    frame = {"gpu": {"gpu_pwr": 0}}
+    restored.contribute(frame)
+    print("restored:", {k: round(v, 3) for k, v in restored.totals.items()}, frame["en"])
+    # Saved to the millijoule
+    assert {k: round(v, 3) for k, v in restored.totals.items()} == {k: round(v, 3) for k, v in totals.items()}
+    assert [row[0] for row in frame["en"]["d"]] == ["cpu", "dram", "gpu"], frame["en"]
+    restored.close()
+    import shutil
+    shutil.rmtree(root)
@@ -0,0 +1,330 @@
+"""Fake host for reproducible runs of the host-side pipeline.
+
+A FakeHost owns a root tree shaped like / (generated at a given size by
+bench.generate_fixture, or a tree recorded with bench.py --record) and a
+FakeClock. Every advance(seconds) moves the clock and rewrites the counter
+files from synthetic generators, so collectors see the counters move the way
+they do on a live machine:
+
+    proc/stat             per-CPU jiffies at USER_HZ from a load profile
+                          (each CPU gets a fixed level plus a slow sine,
+                          chosen by the seed)
+    proc/meminfo          MemAvailable drifting around half of MemTotal
+    proc/net/dev          bytes at fixed per-interface rates
+    proc/net/snmp         segments, retransmits and UDP errors at fixed rates
+    powercap energy_uj    package power integrated, wrapping at
+                          max_energy_range_uj (the tree starts near the wrap)
+    hwmon temp*_input     package and core temperatures following the load
+    NVML                  FakeNvml: load, memory, power and the total energy
+                          counter, or no GPU at all (gpu=False)
+
+The clock is injected by replacing the "time" global of every loaded module
+of this directory with the FakeClock for the duration of a
+`with host.clock.installed():` block; a module first imported inside the
+block would still run on the real clock, so leaving the block raises when
+one is found. monotonic(), time() and sleep() are fake; process_time() and
+perf_counter() stay real, so CPU cost measurements remain meaningful. Given
+the same seed, size and tick sequence, every rate and delta comes out the
+same on any Linux machine. Capacities from statvfs (disk, fs) are those of
+the filesystem holding the tree and are the exception; the Dockerfile next
+to this file runs bench.py --pipeline in a fixed userland with the tree on a
+sized tmpfs, which pins those too.
+
+    host = FakeHost(tmpdir, cpus=64, seed=1)
+    with host.clock.installed():
+        frames = host.run(ticks=60, interval=1.0)
+
+bench.py --pipeline times full ticks (collectors, sources, both wire
+encodings) on a FakeHost.
+"""
+import contextlib
+import math
+import os
+import random
+import re
+import sys
+import time as _time
+
+import bench
+
+USER_HZ = 100
+HOST_DIR = os.path.dirname(os.path.abspath(__file__))
+RAPL = "sys/class/powercap/intel-rapl/intel-rapl:0"
+RAPL_MAX = 262143328850
+
+
+class FakeClock:
+    """Stand-in for the time module: settable monotonic and wall clocks"""
+
+    def __init__(self, start=1000.0, wall=1.7e9):
+        self.mono = start
+        self.wall = wall
+        self.listeners = []
+
+    def monotonic(self):
+        return self.mono
+
+    def time(self):
+        return self.wall
+
+    def sleep(self, seconds):
+        self.advance(seconds)
+
+    def advance(self, seconds):
+        if seconds <= 0:
+            return
+        self.mono += seconds
+        self.wall += seconds
+        for listener in self.listeners:
+            listener(seconds)
+
+    def __getattr__(self, name):
+        # process_time, perf_counter, strftime ... stay real
+        return getattr(_time, name)
+
+    @contextlib.contextmanager
+    def installed(self):
+        patched = _real_clocked()
+        for module in patched:
+            module.time = self
+        try:
+            yield self
+            late = _real_clocked()
+            if late:
+                names = ", ".join(sorted(m.__name__ for m in late))
+                raise RuntimeError(f"{names} imported under the fake clock but running on the real one; "
+                                   "import them before installed()")
+        finally:
+            for module in patched:
+                module.time = _time
+
+
+def _real_clocked():
+    """Loaded modules of this directory whose time global is the real module"""
+    out = []
+    for module in list(sys.modules.values()):
+        path = getattr(module, "__file__", None)
+        if (path and getattr(module, "time", None) is _time
+                and os.path.dirname(os.path.abspath(path)) == HOST_DIR):
+            out.append(module)
+    return out
+
+
+class FakeNvml(bench.MockNvml):
+    """MockNvml with values that follow the FakeHost, plus the energy counter"""
+
+    def __init__(self, host):
+        self.host = host
+
+    @property
+    def values(self):
+        return self.host.gpu
+
+    def nvmlDeviceGetTotalEnergyConsumption(self, handle):
+        return int(self.host.gpu["energy_mj"])
+
+
+class _CounterFile:
+    """A /proc/net/snmp-style file of header/value line pairs"""
+
+    def __init__(self, text):
+        self.rows = []
+        lines = text.splitlines()
+        for header, values in zip(lines[::2], lines[1::2]):
+            prefix, _, names = header.partition(" ")
+            self.rows.append((prefix, names.split(), [int(v) for v in values.split()[1:]]))
+
+    def bump(self, prefix, name, amount):
+        for p, names, values in self.rows:
+            if p == prefix:
+                values[names.index(name)] += amount
+                return
+
+    def text(self):
+        return "".join(f"{p} {' '.join(n)}\n{p} {' '.join(map(str, v))}\n" for p, n, v in self.rows)
+
+
+class FakeHost:
+    def __init__(self, root, cpus=8, procs=0, seed=0, gpu=True, clock=None, generate=True):
+        self.root = root
+        self.rng = random.Random(seed)
+        self.clock = clock or FakeClock()
+        self.clock.listeners.append(self.advance_counters)
+        if generate:
+            bench.generate_fixture(root, cpus, procs)
+        stat = self._read("proc/stat").splitlines()
+        self.cpus = sum(1 for line in stat if re.match(r"cpu\d+ ", line))
+        # Lines other than the cpu rows (intr, ctxt ...) are kept as they are
+        self.stat_tail = [line for line in stat if not line.startswith("cpu")]
+        self.elapsed = 0.0
+
+        rng = self.rng
+        # Load profile per CPU: level, sine amplitude and period (seconds)
+        self.profile = [(rng.uniform(5, 80), rng.uniform(0, 15), rng.uniform(30, 600))
+                        for _ in range(self.cpus)]
+        self.busy = [0.0] * self.cpus
+        self.idle = [0.0] * self.cpus
+        self.meminfo = self._read("proc/meminfo")
+        self.mem_total = int(re.search(r"MemTotal:\s+(\d+)", self.meminfo).group(1))
+        dev = self._read("proc/net/dev").splitlines()
+        self.dev_header = dev[:2]
+        self.ifaces = [line.split(":", 1)[0].strip() for line in dev[2:] if ":" in line]
+        self.net_rates = [rng.randrange(10_000, 50_000_000) for _ in self.ifaces]
+        self.net_bytes = [[0, 0] for _ in self.ifaces]
+        self.snmp = _CounterFile(self._read("proc/net/snmp"))
+        self.pkg_watts = rng.uniform(20, 150)
+        # Start a minute short of the RAPL wrap so runs cross it
+        self.energy_uj = RAPL_MAX - int(self.pkg_watts * 60e6)
+        if not os.path.exists(os.path.join(root, RAPL, "name")):
+            bench._write(root, f"{RAPL}/name", "package-0\n")
+        bench._write(root, f"{RAPL}/max_energy_range_uj", f"{RAPL_MAX}\n")
+        self.gpu = None
+        if gpu:
+            self.gpu = {"gpu": 0, "mem_used": 2 * 1024**3, "mem_total": 12 * 1024**3,
+                        "temp": 40, "power_mw": 30000, "fan": 30, "energy_mj": 5_000_000}
+        self.write_counters()
+
+    def _read(self, path):
+        with open(os.path.join(self.root, path)) as f:
+            return f.read()
+
+    def load(self, cpu, t=None):
+        """Profile load in % of CPU `cpu` at elapsed time t"""
+        level, amp, period = self.profile[cpu]
+        t = self.elapsed if t is None else t
+        return min(100.0, max(0.0, level + amp * math.sin(2 * math.pi * t / period)))
+
+    def nvml(self):
+        return FakeNvml(self) if self.gpu is not None else None
+
+    def advance_counters(self, dt):
+        """Move every counter by dt seconds of synthetic activity"""
+        t = self.elapsed + dt / 2
+        for i in range(self.cpus):
+            jiffies = dt * USER_HZ
+            busy = jiffies * self.load(i, t) / 100
+            self.busy[i] += busy
+            self.idle[i] += jiffies - busy
+        for counters, rate in zip(self.net_bytes, self.net_rates):
+            counters[0] += int(rate * dt)
+            counters[1] += int(rate * dt / 3)
+        segs = int(20000 * dt)
+        self.snmp.bump("Tcp:", "OutSegs", segs)
+        self.snmp.bump("Tcp:", "InSegs", segs)
+        self.snmp.bump("Tcp:", "RetransSegs", int(segs * 0.002))
+        self.snmp.bump("Udp:", "InErrors", int(5 * dt))
+        self.energy_uj = (self.energy_uj + int(self.pkg_watts * dt * 1e6)) % RAPL_MAX
+        if self.gpu is not None:
+            gpu = self.gpu
+            gpu["gpu"] = round(self.load(0, t))
+            gpu["power_mw"] = 30000 + gpu["gpu"] * 2000
+            gpu["energy_mj"] += gpu["power_mw"] * dt
+            gpu["temp"] = 40 + gpu["gpu"] // 3
+        self.elapsed += dt
+        self.write_counters()
+
+    def write_counters(self):
+        root = self.root
+        lines = []
+        for i in range(self.cpus):
+            busy, idle = int(self.busy[i]), int(self.idle[i])
+            user = busy * 7 // 10
+            lines.append(f"cpu{i} {user} 0 {busy - user} {idle} 0 0 0 0 0 0")
+        total = [sum(int(v) for v in col) for col in zip(*(l.split()[1:] for l in lines))]
+        lines.insert(0, "cpu  " + " ".join(map(str, total)))
+        bench._write(root, "proc/stat", "\n".join(lines + self.stat_tail) + "\n")
+
+        avg = sum(self.load(i) for i in range(self.cpus)) / max(1, self.cpus)
+        available = int(self.mem_total * (0.55 - avg / 1000))
+        meminfo = re.sub(r"(MemAvailable:\s+)\d+", rf"\g<1>{available}", self.meminfo)
+        meminfo = re.sub(r"(MemFree:\s+)\d+", rf"\g<1>{available // 2}", meminfo)
+        bench._write(root, "proc/meminfo", meminfo)
+
+        dev = list(self.dev_header)
+        for name, (recv, sent) in zip(self.ifaces, self.net_bytes):
+            dev.append(f"{name:>6}: {recv} {recv // 1400} 0 0 0 0 0 0 {sent} {sent // 1400} 0 0 0 0 0 0")
+        bench._write(root, "proc/net/dev", "\n".join(dev) + "\n")
+        bench._write(root, "proc/net/snmp", self.snmp.text())
+        bench._write(root, f"{RAPL}/energy_uj", f"{self.energy_uj}\n")
+
+        # Generated layout: hwmon1 is coretemp with the package on temp1
+        hw = "sys/class/hwmon/hwmon1"
+        for i in range(self.cpus // 2 + 1):
+            if not os.path.exists(os.path.join(root, hw, f"temp{i + 1}_input")):
+                break
+            load = avg if i == 0 else self.load(2 * (i - 1))
+            bench._write(root, f"{hw}/temp{i + 1}_input", f"{int((38 + load / 2) * 1000)}\n")
+
+    def run(self, ticks, interval=1.0, host=None, sources=(), sinks=(), encode=None):
+        """Drive the monitor's tick sequence without a display; returns the
+        frames (or encode(frame) when given)"""
+        from collectors import HostCollector
+        own = host is None
+        if own:
+            host = HostCollector(self.root, nvml=self.nvml())
+            self.clock.advance(host.PRIME_INTERVAL)
+        frames = []
+        try:
+            for _ in range(ticks):
+                data = host.collect()
+                for source in sources:
+                    source.contribute(data)
+                for sink in sinks:
+                    sink.publish(data, self.clock.time())
+                frames.append(encode(data) if encode else data)
+                self.clock.advance(interval)
+        finally:
+            if own:
+                host.close()
+        return frames
+
+
+if __name__ == "__main__":
+    # Rates and deltas against the generators, and run-to-run determinism
+    import json
+    import shutil
+    import tempfile
+    import registry
+
+    def one_run(seed):
+        tmp = tempfile.mkdtemp(prefix="cyd-fake-")
+        try:
+            host = FakeHost(tmp, cpus=16, seed=seed)
+            with host.clock.installed():
+                frames = host.run(ticks=90, interval=1.0)
+            return host, frames
+        finally:
+            shutil.rmtree(tmp, ignore_errors=True)
+
+    host, frames = one_run(seed=7)
+    last = frames[-1]
+    t = host.elapsed - 0.5
+    expect = [round(host.load(i, t), 1) for i in range(4)]
+    print("core load   ", last["cpu"]["cores"][:4], "expect ~", expect)
+    print("package W   ", [f["cpu"]["pwr"] for f in frames[55:65]], f"expect {host.pkg_watts:.1f} (wraps near tick 60)")
+    print("retrans/s   ", last["proto"]["retr"], "expect 40.0")
+    print("udp err/s   ", last["proto"]["uerr"], "expect 5.0")
+    print("gpu         ", {k: last["gpu"][k] for k in ("gpu_load", "gpu_pwr", "gpu_temp")})
+    # Jiffies are whole numbers, so a core's rate is within a jiffy of the profile
+    for got, want in zip(last["cpu"]["cores"], expect):
+        assert abs(got - want) <= 1.5, (last["cpu"]["cores"][:4], expect)
+    # Package power holds steady across the RAPL wrap
+    for f in frames[5:]:
+        assert abs(f["cpu"]["pwr"] - host.pkg_watts) <= 0.2, (f["cpu"]["pwr"], host.pkg_watts)
+    assert last["proto"]["retr"] == 40.0 and last["proto"]["uerr"] == 5.0, last["proto"]
+    gpu = last["gpu"]
+    assert gpu["gpu_pwr"] == 30 + 2 * gpu["gpu_load"] and gpu["gpu_temp"] == 40 + gpu["gpu_load"] // 3, gpu
+    # A module imported inside the block would run on the real clock
+    assert "statsd" not in sys.modules
+    try:
+        with FakeClock().installed():
+            import statsd
+        raise AssertionError("late import under the fake clock went unnoticed")
+    except RuntimeError as e:
+        assert "statsd" in str(e), e
+
+    digest = [json.dumps([list(registry.encode(registry.flat(f))) for f in frames])]
+    _, again = one_run(seed=7)
+    digest.append(json.dumps([list(registry.encode(registry.flat(f))) for f in again]))
+    print("same seed, same frames:", digest[0] == digest[1])
+    assert digest[0] == digest[1]
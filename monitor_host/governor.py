@@ -0,0 +1,263 @@
+"""Self-overhead accounting and throttling for the monitor process.
+
+The governor is a source that reads the process CPU time at every tick, so
+the figure covers everything the loop did since the previous tick: sampling,
+sources, sinks, serial writes and high-rate samplers. Overhead is reported as
+a percentage of one core, averaged over windows of ADJUST_TICKS ticks so that
+stages running on a stride do not make it jump from tick to tick.
+
+Every stage is charged its own CPU time over the window: each host collector
+(HostCollector.spent), and each source, sink and sampler the loop reports
+through charge(). With a budget set, the governor acts at the end of every
+window with hysteresis:
+
+    over budget         slow the stage costing the most over the window:
+                        double a collector's, source's or sink's stride (runs
+                        every 2nd, 4th ... MAX_STRIDE-th tick) or a sampler's
+                        interval; a collector already at MAX_STRIDE is
+                        disabled, except the cpu and mem collectors, which
+                        stay at MAX_STRIDE. Sources and sinks are never
+                        disabled
+    under budget / 2    undo the last step (re-enable first, then halve)
+
+When no throttleable stage holds MIN_SHARE of the window (the cost is in
+encoding, serial writes or stages marked throttle = False) nothing is slowed.
+Skipped collectors keep their last values in the frame.
+"""
+import os
+import resource
+import sys
+import time
+
+ADJUST_TICKS = 10
+MAX_STRIDE = 16
+# Share of the window's CPU time a stage must hold to be worth slowing
+MIN_SHARE = 0.1
+# Collectors behind the core display: slowed at most, never disabled
+ESSENTIAL = ("cpu", "mem")
+
+MCL_CURRENT = 1
+MCL_FUTURE = 2
+
+
+def apply_priority(sched_idle=False, nice=None, mlock=False):
+    """Lower the monitor's scheduling priority and pin its memory"""
+    if sched_idle:
+        try:
+            os.sched_setscheduler(0, os.SCHED_IDLE, os.sched_param(0))
+            print("Running at SCHED_IDLE")
+        except (AttributeError, OSError) as e:
+            print(f"SCHED_IDLE unavailable: {e}", file=sys.stderr)
+    if nice:
+        os.nice(nice)
+        print(f"Running at nice {os.nice(0)}")
+    if mlock:
+        # Locked pages keep a starved monitor from also stalling on page faults
+        import ctypes
+        import ctypes.util
+        libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        if libc.mlockall(MCL_CURRENT | MCL_FUTURE) != 0:
+            print(f"mlockall failed: {os.strerror(ctypes.get_errno())} "
+                  "(needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)", file=sys.stderr)
+        else:
+            print("Memory locked")
+
+
+class _Stage:
+    __slots__ = ("name", "obj", "spent", "stride", "interval")
+
+    def __init__(self, obj):
+        self.name = getattr(obj, "name", type(obj).__name__)
+        self.obj = obj
+        self.spent = 0.0
+        self.stride = 1
+        # Samplers are slowed through their interval instead of a stride
+        self.interval = getattr(obj, "interval", None) if hasattr(obj, "sample") else None
+
+
+class Governor:
+    # Runs every tick: it is the accounting itself
+    throttle = False
+
+    def __init__(self, host, budget=None):
+        self.host = host
+        self.budget = budget
+        self.window_cpu = time.process_time()
+        self.window_wall = time.monotonic()
+        self.overhead = 0.0
+        self.tick_us = 0.0
+        self.ticks = 0
+        # Sources, sinks and samplers reported by the loop
+        self.stages = {}
+        # Overhead % per stage over the last window, for the control socket
+        self.shares = {}
+        self.stuck = False
+        # Throttling steps taken, newest last, so recovery undoes them in reverse
+        self.steps = []
+
+    def due(self, obj):
+        """Whether a source or sink runs on this tick"""
+        stage = self.stages.get(obj)
+        return stage is None or self.ticks % stage.stride == 0
+
+    def charge(self, obj, seconds):
+        """CPU time spent by a source, sink or sampler"""
+        stage = self.stages.get(obj)
+        if stage is None:
+            stage = self.stages[obj] = _Stage(obj)
+        stage.spent += seconds
+
+    def contribute(self, data):
+        self.ticks += 1
+        if self.ticks % ADJUST_TICKS == 0:
+            cpu = time.process_time()
+            wall = time.monotonic()
+            used = cpu - self.window_cpu
+            elapsed = wall - self.window_wall
+            self.window_cpu, self.window_wall = cpu, wall
+            if elapsed > 0:
+                self.overhead = used / elapsed * 100
+                self.tick_us = used / ADJUST_TICKS * 1e6
+                self.shares = self._close_window(elapsed)
+                if self.budget is not None:
+                    self.adjust()
+        rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+        data["self"] = {"cpu": round(self.overhead, 2), "bud": self.budget or 0,
+                        "us": round(self.tick_us), "rss": round(rss, 1), "thr": self.describe()}
+
+    def _close_window(self, elapsed):
+        """{(kind, key): overhead %} for the window just ended"""
+        shares = {}
+        host = self.host
+        for i, spent in enumerate(host.spent):
+            shares[("collector", i)] = spent / elapsed * 100
+            host.spent[i] = 0.0
+        for obj, stage in self.stages.items():
+            shares[("stage", obj)] = stage.spent / elapsed * 100
+            stage.spent = 0.0
+        return shares
+
+    def _slowable(self, key):
+        kind, k = key
+        if kind == "collector":
+            host = self.host
+            if k in host.held or host.stride[k] == 0:
+                return False
+            return host.stride[k] < MAX_STRIDE or host.collectors[k].name not in ESSENTIAL
+        stage = self.stages[k]
+        if not getattr(k, "throttle", True):
+            return False
+        if stage.interval is not None:
+            return k.interval < stage.interval * MAX_STRIDE
+        return stage.stride < MAX_STRIDE
+
+    def _name(self, key):
+        kind, k = key
+        return self.host.collectors[k].name if kind == "collector" else self.stages[k].name
+
+    def adjust(self):
+        host = self.host
+        if self.overhead > self.budget:
+            candidates = [key for key in self.shares if self._slowable(key)]
+            key = max(candidates, key=self.shares.get, default=None)
+            if key is None or self.shares[key] < self.overhead * MIN_SHARE:
+                if not self.stuck:
+                    top = max(self.shares, key=self.shares.get, default=None)
+                    where = f"; {self._name(top)} leads at {self.shares[top]:.2f}%" if top else ""
+                    print(f"Over budget ({self.overhead:.2f}% > {self.budget}%) "
+                          f"with nothing left worth slowing{where}", file=sys.stderr)
+                self.stuck = True
+                return
+            self.stuck = False
+            kind, k = key
+            if kind == "collector":
+                if host.stride[k] < MAX_STRIDE:
+                    host.stride[k] *= 2
+                    self.steps.append((key, "stride"))
+                else:
+                    host.stride[k] = 0
+                    self.steps.append((key, "off"))
+            else:
+                stage = self.stages[k]
+                if stage.interval is not None:
+                    k.interval *= 2
+                else:
+                    stage.stride *= 2
+                self.steps.append((key, "stride"))
+            print(f"Over budget ({self.overhead:.2f}% > {self.budget}%, "
+                  f"{self._name(key)} {self.shares[key]:.2f}%): {self.describe()}")
+        elif self.overhead < self.budget / 2 and self.steps:
+            self.stuck = False
+            (kind, k), step = self.steps.pop()
+            if kind == "stage":
+                stage = self.stages[k]
+                if stage.interval is not None:
+                    k.interval = max(stage.interval, k.interval / 2)
+                else:
+                    stage.stride = max(1, stage.stride // 2)
+                return
+            # A stride the operator has set since then stays as set
+            if k in host.held:
+                return
+            if step == "off":
+                host.stride[k] = MAX_STRIDE
+            else:
+                host.stride[k] = max(1, host.stride[k] // 2)
+
+    def describe(self):
+        parts = []
+        for c, stride in zip(self.host.collectors, self.host.stride):
+            if stride == 0:
+                parts.append(f"{c.name} off")
+            elif stride > 1:
+                parts.append(f"{c.name}/{stride}")
+        for obj, stage in self.stages.items():
+            if stage.interval is not None and obj.interval > stage.interval:
+                parts.append(f"{stage.name}/{round(obj.interval / stage.interval)}")
+            elif stage.stride > 1:
+                parts.append(f"{stage.name}/{stage.stride}")
+        return " ".join(parts)[:24]
+
+    def close(self):
+        pass
+
+
+if __name__ == "__main__":
+    # A generated 256-CPU host plus a source that burns most of the CPU: the
+    # source is slowed first, and cpu/mem are never switched off
+    import shutil
+    import tempfile
+    from bench import generate_fixture, MockNvml
+    from collectors import HostCollector
+
+    class Burner:
+        name = "burner"
+
+        def contribute(self, data):
+            end = time.process_time() + 0.004
+            while time.process_time() < end:
+                pass
+
+    root = tempfile.mkdtemp(prefix="cyd-gov-")
+    generate_fixture(root, 256, procs=0)
+    host = HostCollector(root, nvml=MockNvml(root))
+    gov = Governor(host, budget=float(sys.argv[1]) if len(sys.argv) > 1 else 2.0)
+    burner = Burner()
+    interval = 0.01
+    for tick in range(600):
+        data = host.collect()
+        for source in (burner, gov):
+            if gov.due(source):
+                start = time.process_time()
+                source.contribute(data)
+                if source is not gov:
+                    gov.charge(source, time.process_time() - start)
+        if tick % 100 == 99:
+            print(f"tick {tick + 1}: {data['self']}")
+        time.sleep(interval)
+    host.close()
+    shutil.rmtree(root, ignore_errors=True)
+    assert gov.stages[burner].stride > 1, "the costly source was not slowed"
+    for name in ESSENTIAL:
+        assert host.stride[host.index(name)] > 0, f"{name} collector was disabled"
+    print("governor check passed")
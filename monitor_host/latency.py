@@ -0,0 +1,114 @@
+"""Sample-to-pixel latency: how old the numbers on the display are.
+
+Every stats frame carries an "id". The host keeps, per id, the time the
+sample was taken and the time the serial write returned. The device echoes
+the id in its {"t":"tr"} line, with micros() stamps for receive, parse, draw
+and push. Each echo is split into stages:
+
+    host    sample taken -> serial write returned (collect, sources, sinks,
+            json.dumps, write syscall)
+    uart    write returned -> device finished reading the line (USB/UART,
+            time waiting for the device loop, readStringUntil)
+    parse   deserializeJson
+    draw    page render into the sprite
+    push    pushSprite to the panel
+    total   sample taken -> push done
+
+host, uart and total need the device clock (timeline.DeviceClock) and are
+skipped until the first pong. Each stage feeds a WindowedSketch; p50/p99
+over the window go into the frame ("lat", milliseconds) and are logged every
+LOG_INTERVAL seconds.
+"""
+import time
+
+from sketch import WindowedSketch
+from timeline import DeviceClock
+
+WINDOW = 60
+LOG_INTERVAL = 60
+MAX_INFLIGHT = 64
+
+STAGES = ("total", "host", "uart", "parse", "draw", "push")
+
+
+class LatencyTracker:
+    # Runs every tick whatever the overhead budget (frame timing)
+    throttle = False
+
+    def __init__(self, window=WINDOW):
+        self.clock = DeviceClock()
+        self.sketches = {name: WindowedSketch(window) for name in STAGES}
+        self.frame_id = 0
+        # frame id -> [sample time, write-returned time]
+        self.inflight = {}
+        self.next_log = time.monotonic() + LOG_INTERVAL
+
+    def reset(self):
+        """New link: realign the device clock; frames sent on the old link
+        will never be echoed"""
+        self.clock.reset()
+        self.inflight.clear()
+
+    def next_frame(self, sampled):
+        self.frame_id += 1
+        self.inflight[self.frame_id] = [sampled, None]
+        if len(self.inflight) > MAX_INFLIGHT:
+            # Frames the device never answered (dropped line, other page)
+            del self.inflight[min(self.inflight)]
+        return self.frame_id
+
+    def frame_written(self, frame_id, written):
+        stamps = self.inflight.get(frame_id)
+        if stamps:
+            stamps[1] = written
+
+    def receive(self, msg, now):
+        if msg.get("t") != "tr":
+            return
+        stamps = self.inflight.pop(msg.get("id"), None)
+        if not stamps or stamps[1] is None:
+            return
+        sampled, written = stamps
+        add = self._add
+        for key, name in (("ps", "parse"), ("dr", "draw"), ("pu", "push")):
+            if key in msg:
+                add(name, msg[key][1] / 1000, now)
+        add("host", (written - sampled) * 1000, now)
+        clock = self.clock
+        if clock.offset is None or "rx" not in msg or "pu" not in msg:
+            return
+        sampled_us = clock.us(sampled)
+        rx, rx_dur = msg["rx"]
+        pu, pu_dur = msg["pu"]
+        add("uart", (clock.host_us(rx) + rx_dur - clock.us(written)) / 1000, now)
+        add("total", (clock.host_us(pu) + pu_dur - sampled_us) / 1000, now)
+
+    def _add(self, name, ms, now):
+        # Clock-offset error can push a short stage slightly negative
+        self.sketches[name].add(max(ms, 0.001), now)
+
+    def percentiles(self, now):
+        out = {}
+        for name, sk in self.sketches.items():
+            p50, p99 = sk.merged(now).quantiles((0.5, 0.99))
+            if p50 is not None:
+                out[name] = [round(p50, 1), round(p99, 1)]
+        return out
+
+    def contribute(self, data):
+        now = time.monotonic()
+        lat = self.percentiles(now)
+        if lat:
+            data["lat"] = lat
+        if now >= self.next_log and lat:
+            self.next_log = now + LOG_INTERVAL
+            self.log(lat)
+
+    def log(self, lat):
+        parts = "  ".join(f"{name} {p[0]}/{p[1]}" for name, p in lat.items())
+        print(f"Latency p50/p99 ms: {parts}")
+
+    def close(self):
+        lat = self.percentiles(time.monotonic())
+        if lat:
+            self.log(lat)
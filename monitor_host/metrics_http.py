@@ -0,0 +1,190 @@
+"""Prometheus / OpenMetrics endpoint serving the already-collected sample.
+
+The exposition text is rendered once per tick in publish(); the HTTP handler
+only copies the pre-encoded buffer, so scrape rate does not affect cost.
+"""
+import math
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from registry import NAMES, reader
+
+PROM_TYPE = "text/plain; version=0.0.4; charset=utf-8"
+OPENMETRICS_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+
+def _series_for(field):
+    """Map a dotted field to (metric name, label string)"""
+    parts = field.split(".")
+    if parts[-1].isdigit():
+        # cpu.cores.3 -> cyd_cpu_cores{index="3"}
+        return "cyd_" + "_".join(parts[:-1]), f'{{index="{parts[-1]}"}}'
+    return "cyd_" + "_".join(parts), ""
+
+
+class MetricsServer:
+    def __init__(self, port, bind="127.0.0.1", fields=NAMES):
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.series = [_series_for(f) for f in self.fields]
+        self.extra = {}
+        self.prom_body = b""
+        self.om_body = b"# EOF\n"
+        self.scrapes = 0
+
+        server = self
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                if self.path.split("?", 1)[0] != "/metrics":
+                    self.send_error(404)
+                    return
+                if "application/openmetrics-text" in self.headers.get("Accept", ""):
+                    body, ctype = server.om_body, OPENMETRICS_TYPE
+                else:
+                    body, ctype = server.prom_body, PROM_TYPE
+                server.scrapes += 1
+                self.send_response(200)
+                self.send_header("Content-Type", ctype)
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def log_message(self, format, *args):
+                pass
+
+        self.httpd = ThreadingHTTPServer((bind, port), Handler)
+        self.httpd.daemon_threads = True
+        self.port = self.httpd.server_address[1]
+        self.thread = threading.Thread(target=self.httpd.serve_forever, name="metrics-http", daemon=True)
+        self.thread.start()
+        print(f"Serving metrics on http://{bind}:{self.port}/metrics")
+
+    def set_extra(self, name, value, labels="", kind="gauge"):
+        """Add a series outside the stats dict (rendered on the next publish)"""
+        self.extra[(name, labels)] = (value, kind)
+
+    def publish(self, data, ts=None):
+        """Render the exposition once for this tick"""
+        values = self.read(data)
+        lines = []
+        last_name = None
+        for (name, labels), value in zip(self.series, values):
+            if math.isnan(value):
+                continue
+            if name != last_name:
+                lines.append(f"# TYPE {name} gauge")
+                last_name = name
+            lines.append(f"{name}{labels} {value:g}")
+        prom, om = list(lines), lines
+        for (name, labels), (value, kind) in sorted(self.extra.items()):
+            if name != last_name:
+                # The 0.0.4 format types the sample name; OpenMetrics names a
+                # counter family without its _total suffix
+                family = name[:-len("_total")] if kind == "counter" and name.endswith("_total") else name
+                prom.append(f"# TYPE {name} {kind}")
+                om.append(f"# TYPE {family} {kind}")
+                last_name = name
+            sample = f"{name}{labels} {value:g}"
+            prom.append(sample)
+            om.append(sample)
+        stamp = ["# TYPE cyd_sample_timestamp_seconds gauge",
+                 f"cyd_sample_timestamp_seconds {time.time() if ts is None else ts:.3f}"]
+        # Swap whole buffers so a concurrent scrape sees either tick, never a mix
+        self.prom_body = ("\n".join(prom + stamp) + "\n").encode()
+        self.om_body = ("\n".join(om + stamp) + "\n# EOF\n").encode()
+
+    def close(self):
+        self.httpd.shutdown()
+        self.httpd.server_close()
+
+
+def parse_exposition(text, openmetrics=False):
+    """{(sample name, labels): (value, type)} from a rendered body; uses
+    prometheus_client's parsers when installed, else checks the TYPE rules
+    itself. Raises ValueError on a body a strict scraper would reject."""
+    try:
+        if openmetrics:
+            from prometheus_client.openmetrics.parser import text_string_to_metric_families
+        else:
+            from prometheus_client.parser import text_string_to_metric_families
+    except ImportError:
+        text_string_to_metric_families = None
+    out = {}
+    if text_string_to_metric_families is not None:
+        for family in text_string_to_metric_families(text):
+            for sample in family.samples:
+                labels = ",".join(f'{k}="{v}"' for k, v in sorted(sample.labels.items()))
+                out[(sample.name, labels)] = (sample.value, family.type)
+        return out
+    if openmetrics and not text.endswith("# EOF\n"):
+        raise ValueError("OpenMetrics body without # EOF")
+    family = kind = None
+    for line in text.splitlines():
+        if line.startswith("# TYPE "):
+            _, _, family, kind = line.split(" ")
+            continue
+        if not line or line.startswith("#"):
+            continue
+        series, _, value = line.rpartition(" ")
+        name, _, labels = series.partition("{")
+        expect = family + "_total" if openmetrics and kind == "counter" else family
+        if name != expect:
+            raise ValueError(f"{name}: sample does not match # TYPE {family} {kind}")
+        labels = ",".join(sorted(labels.rstrip("}").split(","))) if labels else ""
+        out[(name, labels)] = (float(value), kind)
+    return out
+
+
+if __name__ == "__main__":
+    import urllib.error
+    import urllib.request
+    srv = MetricsServer(0)
+    srv.set_extra("cyd_energy_joules_total", 1234.5, '{domain="cpu"}', kind="counter")
+    srv.set_extra("cyd_energy_wh", 0.5, '{domain="cpu",window="1h"}')
+    srv.publish({"cpu": {"load": 12.5, "cores": [1.0, 2.0]}, "ram": {"p": 40.0}}, ts=1700000000.0)
+    url = f"http://127.0.0.1:{srv.port}/metrics"
+    om_req = urllib.request.Request(url, headers={"Accept": "application/openmetrics-text"})
+
+    def scrape(req=url):
+        with urllib.request.urlopen(req) as resp:
+            return resp.headers["Content-Type"], resp.read().decode()
+
+    ctype, prom = scrape()
+    assert ctype == PROM_TYPE, ctype
+    ctype, om = scrape(om_req)
+    assert ctype == OPENMETRICS_TYPE, ctype
+    sys.stdout.write(prom)
+    for body, openmetrics in ((prom, False), (om, True)):
+        samples = parse_exposition(body, openmetrics)
+        fmt = "OpenMetrics" if openmetrics else "0.0.4"
+        assert samples[("cyd_energy_joules_total", 'domain="cpu"')] == (1234.5, "counter"), fmt
+        assert samples[("cyd_energy_wh", 'domain="cpu",window="1h"')] == (0.5, "gauge"), fmt
+        assert samples[("cyd_cpu_load", "")] == (12.5, "gauge"), fmt
+        assert samples[("cyd_cpu_cores", 'index="1"')][0] == 2.0, fmt
+        assert samples[("cyd_sample_timestamp_seconds", "")][0] == 1700000000.0, fmt
+        # Fields missing from the frame are left out, not exported as NaN
+        assert not any(name.startswith("cyd_gpu_") for name, _ in samples), fmt
+        print(f"{fmt} body parses: {len(samples)} samples")
+
+    # The next publish replaces the body; a field that disappears goes with it
+    srv.publish({"cpu": {"load": 50.0}, "ram": {"p": 41.0}}, ts=1700000001.0)
+    samples = parse_exposition(scrape()[1])
+    assert samples[("cyd_cpu_load", "")][0] == 50.0
+    assert ("cyd_cpu_cores", 'index="1"') not in samples
+    assert samples[("cyd_sample_timestamp_seconds", "")][0] == 1700000001.0
+
+    try:
+        scrape(f"http://127.0.0.1:{srv.port}/other")
+        raise AssertionError("expected 404 for a path other than /metrics")
+    except urllib.error.HTTPError as e:
+        assert e.code == 404, e.code
+    assert srv.scrapes == 3, srv.scrapes
+    n = 500
+    start = time.perf_counter()
+    for _ in range(n):
+        urllib.request.urlopen(url).read()
+    print(f"{(time.perf_counter() - start) / n * 1e6:.0f} us/scrape over loopback")
+    srv.close()
@@ -1,12 +1,26 @@
 import time
+# Start of the process, for the time-to-first-frame log line
+STARTED = time.monotonic()
 import json
 import argparse
-import psutil
 import serial
-import serial.tools.list_ports
 import sys
 import os
+import select
+import signal
 import warnings
+from shm import DEFAULT_SHM_PATH
+from tsdb import DEFAULT_STORE_PATH
+from archive import DEFAULT_ARCHIVE_PATH
+from energy import DEFAULT_ENERGY_PATH
+from control import DEFAULT_CONTROL_PATH
+from alerts import AlertEngine, DEFAULT_RULES, load_rules
+from collectors import HostCollector
+from governor import Governor, apply_priority
+from latency import LatencyTracker
+import registry
+# Feature modules are imported where their flag is handled so the default
+# start-up (and the first frame) does not pay for http.server and friends
 warnings.filterwarnings("ignore", category=FutureWarning)
 
 def auto_detect_esp32_port():
@@ -16,6 +30,7 @@ def auto_detect_esp32_port():
         (0x303A, None),     # Espressif (any product)
     ]
     
+    import serial.tools.list_ports
     ports = serial.tools.list_ports.comports()
     for port in ports:
         if port.vid is not None:
@@ -25,125 +40,69 @@ def auto_detect_esp32_port():
                         return port.device
     return None
 
-try:
-    import pynvml
-except ImportError:
-    pynvml = None
+_host = None
 
-def get_nvidia_stats():
-    if not pynvml:
-        return {
-            "gpu_load": 0, "vram_used": 0, "vram_total": 0, "vram_p": 0, "gpu_temp": 0, "gpu_pwr": 0
-        }
-    try:
-        pynvml.nvmlInit()
-        handle = pynvml.nvmlDeviceGetHandleByIndex(0)
-        
-        util = pynvml.nvmlDeviceGetUtilizationRates(handle)
-        gpu_load = util.gpu
-        
-        mem = pynvml.nvmlDeviceGetMemoryInfo(handle)
-        vram_used = mem.used / 1024**2
-        vram_total = mem.total / 1024**2
-        vram_percent = (vram_used / vram_total) * 100
-        
-        temp = pynvml.nvmlDeviceGetTemperature(handle, pynvml.NVML_TEMPERATURE_GPU)
-        
-        power_usage = pynvml.nvmlDeviceGetPowerUsage(handle) / 1000.0
 
-        try:
-            gpu_fan = pynvml.nvmlDeviceGetFanSpeed(handle)
-        except:
-            gpu_fan = 0
-
-        pynvml.nvmlShutdown()
-        return {
-            "gpu_load": gpu_load,
-            "vram_used": round(vram_used, 1),
-            "vram_total": round(vram_total, 1),
-            "vram_p": round(vram_percent, 1),
-            "gpu_temp": temp,
-            "gpu_pwr": round(power_usage, 1),
-            "gpu_fan": gpu_fan
-        }
-    except Exception as e:
-        return {
-            "gpu_load": 0, "vram_used": 0, "vram_total": 0, "vram_p": 0, "gpu_temp": 0, "gpu_pwr": 0, "gpu_fan": 0
-        }
+def host_collector():
+    global _host
+    if _host is None:
+        _host = HostCollector(nvml="pynvml")
+    return _host
 
-def get_cpu_fan():
-    try:
-        fans = psutil.sensors_fans()
-        if not fans:
-            return 0
-        for name, entries in fans.items():
-            for entry in entries:
-                if entry.current > 0:
-                    return int(entry.current)
-        return 0
-    except:
-        return 0
-
-def get_cpu_temp():
-    try:
-        temps = psutil.sensors_temperatures()
-        if not temps:
-            return 0
-        
-        all_temps = []
-        for name, entries in temps.items():
-            if name in ['coretemp', 'k10temp', 'zenpower']:
-                for entry in entries:
-                    if 'Core' in entry.label or 'Tctl' in entry.label:
-                        all_temps.append(entry.current)
-        
-        if all_temps:
-            return sum(all_temps) / len(all_temps)
-        
-        return list(temps.values())[0][0].current
-    except:
-        return 0
 
-last_rapl_energy = 0
-last_rapl_time = 0
-
-def get_cpu_power():
-    global last_rapl_energy, last_rapl_time
-    try:
-        with open("/sys/class/powercap/intel-rapl/intel-rapl:0/energy_uj", "r") as f:
-            energy = int(f.read())
-            
-        current_time = time.time()
-        
-        if last_rapl_time == 0:
-            last_rapl_energy = energy
-            last_rapl_time = current_time
-            return 0.0
-            
-        delta_energy = energy - last_rapl_energy
-        delta_time = current_time - last_rapl_time
-        
-        if delta_energy < 0:
-            delta_energy = 0
-            
-        watts = (delta_energy / 1000000.0) / delta_time
-        
-        last_rapl_energy = energy
-        last_rapl_time = current_time
-        
-        return round(watts, 1)
-    except:
-        return 0.0
+def collect_stats():
+    """Collect one sample of all host metrics"""
+    return host_collector().collect()
 
 
 class SerialManager:
-    def __init__(self, port=None, baud=115200):
+    # Wire encodings for stats frames (switchable over the control socket):
+    # "ids" sends the registered metrics as one array indexed by metric ID
+    PROTOCOLS = ("json", "ids")
+    # Seconds to wait for the device to acknowledge a baud switch, then for a
+    # pong at the new rate
+    BAUD_ACK_TIMEOUT = 0.5
+    BAUD_CONFIRM_TIMEOUT = 1.0
+
+    def __init__(self, port=None, baud=115200, sinks=None, sources=None, samplers=None,
+                 feeds=None, priority=None, headless=False, interval=1.0, tracer=None,
+                 latency=None, ready_at=0.0, protocol="json"):
         self.port = port
+        # The device boots at boot_baud; want_baud is switched to after connect
+        self.boot_baud = baud
         self.baud = baud
+        self.want_baud = baud
+        self.baud_ack = None
+        # Baud switch in progress: (stage, rate, previous rate, deadline, pongs)
+        self.baud_switch = None
+        self.protocol = protocol
+        # Control socket: serves commands while the loop is idle
+        self.control = None
+        # Overhead governor: charged per stage, may run stages on a stride
+        self.governor = None
+        self.sinks = sinks or []
+        self.sources = sources or []
+        self.samplers = samplers or []
+        # Sources and samplers switched off over the control socket
+        self.off = set()
+        self.feeds = feeds or []
+        self.priority = priority or []
+        self.headless = headless
+        self.interval = interval
+        self.tracer = tracer
+        self.latency = latency or LatencyTracker()
+        self.clock = self.latency.clock
+        # Earliest time the first frame carries primed rates
+        self.ready_at = ready_at
+        # Set on connect and cleared once the first frame is out
+        self.connected_at = None
+        self.rx_buf = bytearray()
         self.serial = None
         self.connected = False
         self.backoff = 1
         self.max_backoff = 30
+        self.next_retry = 0
+        self.next_tick = 0.0
         
     def find_port(self):
         """Auto-detect ESP32 port if not manually specified"""
@@ -165,9 +124,12 @@ class SerialManager:
             return False
 
         try:
+            self.baud = self.boot_baud
             self.serial = serial.Serial(target_port, self.baud, timeout=1)
             print(f"Connected to {target_port}")
             self.connected = True
+            self.connected_at = time.monotonic()
+            self.reset_link()
             self.backoff = 1  # Reset backoff on successful connection
             self.port = target_port # Cache the found port 
             return True
@@ -185,99 +147,297 @@ class SerialManager:
                 pass
         self.serial = None
         self.connected = False
+        self.baud_switch = None
+        self.reset_link()
         print("Disconnected.")
 
+    def reset_link(self):
+        """Per-link state: the device on the other end may have rebooted"""
+        self.rx_buf.clear()
+        self.latency.reset()
+        if self.tracer:
+            self.tracer.reset()
+
+    def encode(self, data):
+        """One frame as a line in the current protocol"""
+        if self.protocol == "ids" and "cpu" in data:
+            data = registry.wire_frame(data)
+        return (json.dumps(data) + '\n').encode('utf-8')
+
     def write(self, data):
         """Write data to serial port, handle errors"""
         if not self.connected or not self.serial:
             return False
             
         try:
-            json_str = json.dumps(data)
-            self.serial.write((json_str + '\n').encode('utf-8'))
+            start = time.monotonic()
+            payload = self.encode(data)
+            serialized = time.monotonic()
+            self.serial.write(payload)
+            written = time.monotonic()
+            if self.connected_at is not None and "cpu" in data:
+                print(f"First frame {(written - self.connected_at) * 1000:.0f} ms after connect "
+                      f"({(written - STARTED) * 1000:.0f} ms after start)")
+                self.connected_at = None
+            if "id" in data:
+                self.latency.frame_written(data["id"], written)
+                if self.tracer:
+                    self.tracer.frame_written(data["id"], start, serialized, written,
+                                              len(payload), self.baud)
             return True
         except Exception as e:
             print(f"Write error: {e}", file=sys.stderr)
             self.disconnect()
             return False
 
+    def poll_input(self):
+        """Consume whatever the device has sent without blocking; replies are
+        stamped with the time they were read"""
+        if not self.connected or not self.serial:
+            return
+        try:
+            waiting = self.serial.in_waiting
+            if waiting:
+                self.rx_buf += self.serial.read(waiting)
+        except Exception as e:
+            print(f"Read error: {e}", file=sys.stderr)
+            self.disconnect()
+            return
+        now = time.monotonic()
+        while True:
+            end = self.rx_buf.find(b"\n")
+            if end < 0:
+                break
+            line = bytes(self.rx_buf[:end]).strip()
+            del self.rx_buf[:end + 1]
+            # Boot messages and debug prints are not JSON
+            if not line.startswith(b"{"):
+                continue
+            try:
+                msg = json.loads(line)
+                if msg.get("t") == "pong":
+                    self.clock.pong(msg, now)
+                elif msg.get("t") == "baud":
+                    self.baud_ack = msg.get("v")
+                self.latency.receive(msg, now)
+                if self.tracer:
+                    self.tracer.receive(msg, now)
+            except (ValueError, KeyError, TypeError, IndexError, AttributeError):
+                # Garbled line or missing fields (old firmware, bad baud):
+                # drop the message, not the link
+                continue
+        if len(self.rx_buf) > 4096:
+            self.rx_buf.clear()
+
+    def ping(self, now):
+        """Clock-alignment exchange; the pong is handled by poll_input, which
+        the idle wait wakes for as soon as it arrives"""
+        self.write(self.clock.ping_frame(now))
+
+    def start_baud_switch(self, now):
+        """Ask the device to move to want_baud; it acknowledges at the old rate"""
+        self.baud_ack = None
+        self.write({"t": "baud", "v": self.want_baud})
+        self.baud_switch = ("ack", self.want_baud, self.baud, now + self.BAUD_ACK_TIMEOUT, 0)
+
+    def step_baud_switch(self, now):
+        """Advance a baud switch from the loop without waiting: after the ack
+        the link moves to the new rate, and a pong there confirms it (the
+        device falls back by itself when no frame reaches it at the new rate)"""
+        stage, baud, old, deadline, pongs = self.baud_switch
+        if stage == "ack":
+            if self.baud_ack != baud:
+                if now >= deadline:
+                    print(f"Device did not acknowledge {baud} baud; staying at {old}", file=sys.stderr)
+                    self.want_baud = old
+                    self.baud_switch = None
+                return
+            try:
+                self.serial.flush()
+                self.serial.baudrate = baud
+            except Exception as e:
+                print(f"Cannot set {baud} baud: {e}", file=sys.stderr)
+                self.disconnect()
+                return
+            self.baud = baud
+            self.rx_buf.clear()
+            self.baud_switch = ("confirm", baud, old, now + self.BAUD_CONFIRM_TIMEOUT, self.clock.pongs)
+            self.ping(now)
+        elif self.clock.pongs != pongs:
+            print(f"Link switched to {baud} baud")
+            self.baud_switch = None
+        elif now >= deadline:
+            print(f"No reply at {baud} baud; back to {old}", file=sys.stderr)
+            self.serial.baudrate = old
+            self.baud = self.want_baud = old
+            self.baud_switch = None
+
+    def set_interval(self, interval):
+        """New frame interval, effective from the next tick"""
+        self.interval = interval
+        self.next_tick = min(self.next_tick, time.monotonic() + interval)
+
+    def set_port(self, port):
+        """Reconnect on another port (None = auto-detect)"""
+        self.port = port
+        self.disconnect()
+        self.next_retry = 0
+
+    def sleep(self, seconds):
+        """Idle wait; device input ends it early so replies are read on arrival"""
+        wake = None
+        if self.connected and self.serial:
+            try:
+                wake = self.serial.fileno()
+            except Exception:
+                pass
+        if self.control:
+            self.control.wait(seconds, wake)
+        elif wake is not None:
+            select.select([wake], [], [], seconds)
+        else:
+            time.sleep(seconds)
+
+    def run_samplers(self, now):
+        """Run every high-rate sampler that is due; return the next due time"""
+        next_due = float("inf")
+        gov = self.governor
+        for sampler in self.samplers:
+            if sampler in self.off:
+                continue
+            if now >= sampler.next_due:
+                start = time.process_time()
+                try:
+                    sampler.sample(now)
+                except Exception as e:
+                    print(f"Sampler error: {e}", file=sys.stderr)
+                if gov:
+                    gov.charge(sampler, time.process_time() - start)
+                # Skip missed slots instead of bursting to catch up
+                sampler.next_due = max(sampler.next_due + sampler.interval, now)
+            next_due = min(next_due, sampler.next_due)
+        return next_due
+
     def run(self):
-        """Main loop"""
+        """Main loop; sinks, sources and the tracer are closed however it ends"""
+        try:
+            self._loop()
+        finally:
+            # One failing close must not keep the others (archive, energy
+            # state, store, shm file) from being written out
+            for part in self.sinks + self.sources + [self.control, self.tracer]:
+                if part is None:
+                    continue
+                try:
+                    part.close()
+                except Exception as e:
+                    print(f"Error closing {type(part).__name__}: {e}", file=sys.stderr)
+            self.disconnect()
+
+    def _loop(self):
         print("Starting Monitor with Auto-Reconnect...")
+        self.next_tick = max(time.monotonic(), self.ready_at)
         
         while True:
             # Reconnection logic
-            if not self.connected:
+            if not self.connected and not self.headless and time.monotonic() >= self.next_retry:
                 if self.connect():
-                    # Just connected, proceed immediately
-                    pass 
+                    # Just connected: the display gets a frame now instead of
+                    # waiting out the rest of the interval
+                    self.next_tick = max(time.monotonic(), self.ready_at)
                 else:
                     # Connection failed, wait and retry
                     wait_time = self.backoff
                     print(f"Waiting {wait_time}s before retry...")
-                    time.sleep(wait_time)
+                    self.next_retry = time.monotonic() + wait_time
                     # Exponential backoff with jitter could be added, but simple doubling is fine
                     self.backoff = min(self.backoff * 2, self.max_backoff)
+
+            # Local sinks keep receiving samples while the display is unplugged
+            if not self.connected and not self.sinks:
+                self.sleep(max(0, self.next_retry - time.monotonic()))
+                continue
+
+            now = time.monotonic()
+            next_due = self.run_samplers(now)
+            self.poll_input()
+            # Link upkeep waits until the first frame is on screen
+            if self.connected and self.connected_at is None:
+                try:
+                    # A baud change (control socket, or re-applied after a reconnect)
+                    if self.baud_switch:
+                        self.step_baud_switch(now)
+                    elif self.baud != self.want_baud:
+                        self.start_baud_switch(now)
+                    elif now >= self.clock.next_ping:
+                        self.ping(now)
+                except Exception as e:
+                    # Port gone mid-switch (baudrate setter, flush): reconnect
+                    print(f"Link error: {e}", file=sys.stderr)
+                    self.disconnect()
+                # Frames wait for the ack: one sent at the old rate after the
+                # device has switched would be garbled
+                if self.baud_switch and self.baud_switch[0] == "ack":
+                    self.sleep(max(0, min(self.baud_switch[3], next_due) - time.monotonic()))
                     continue
+            if now < self.next_tick:
+                wake = min(self.next_tick, next_due)
+                if self.baud_switch:
+                    wake = min(wake, self.baud_switch[3])
+                self.sleep(max(0, wake - time.monotonic()))
+                continue
+            self.next_tick = max(self.next_tick + self.interval, now)
 
             # Stats Collection
             try:
-                cpu_percent = psutil.cpu_percent(interval=None)
-                cpu_freq = psutil.cpu_freq().current if psutil.cpu_freq() else 0
-                cpu_temp = get_cpu_temp()
-                cpu_pwr = get_cpu_power()
-                cpu_fan = get_cpu_fan()
-                cpu_per_core = psutil.cpu_percent(interval=None, percpu=True)
-                
-                ram = psutil.virtual_memory()
-                ram_used = ram.used / 1024**3
-                ram_total = ram.total / 1024**3
-                
-                swap = psutil.swap_memory()
-                swap_used = swap.used / 1024**3
-                
-                gpu_stats = get_nvidia_stats()
-                
-                disk = psutil.disk_usage('/')
-                disk_used_p = disk.percent
-                
-                net = psutil.net_io_counters()
-                net_sent = net.bytes_sent / 1024**2
-                net_recv = net.bytes_recv / 1024**2
-                
-                data = {
-                    "cpu": {
-                        "load": round(cpu_percent, 1),
-                        "temp": round(cpu_temp, 1),
-                        "freq": round(cpu_freq, 0),
-                        "pwr": cpu_pwr,
-                        "fan": cpu_fan,
-                        "cores": [round(c, 1) for c in cpu_per_core[:16]]
-                    },
-                    "ram": {
-                        "used": round(ram_used, 1),
-                        "total": round(ram_total, 1),
-                        "p": round(ram.percent, 1)
-                    },
-                    "swap": {
-                        "used": round(swap_used, 1),
-                        "p": round(swap.percent, 1)
-                    },
-                    "gpu": gpu_stats,
-                    "disk": {
-                        "p": disk_used_p
-                    },
-                    "net": {
-                        "sent": round(net_sent, 1),
-                        "recv": round(net_recv, 1)
-                    }
-                }
-
-                # Send Data
-                if not self.write(data):
-                    # If write failed, we are already disconnected by self.write()
-                    # Loop will handle reconnection next iteration
-                    pass
+                tr = self.tracer
+                sampled = time.monotonic()
+                data = collect_stats()
+                if tr:
+                    tr.span("collect", sampled)
+                data["id"] = self.latency.next_frame(sampled)
+
+                gov = self.governor
+                for source in self.sources:
+                    if source in self.off or (gov and not gov.due(source)):
+                        continue
+                    start = time.monotonic()
+                    cpu = time.process_time()
+                    source.contribute(data)
+                    if gov:
+                        gov.charge(source, time.process_time() - cpu)
+                    if tr:
+                        tr.span(type(source).__name__, start, cat="source")
+
+                # Sinks and the wire share one walk of the finished frame
+                with registry.tick(data):
+                    # State changes (alerts) go out before local sinks
+                    # and ahead of the larger stats frame
+                    for feed in self.priority:
+                        for frame in feed.frames(now):
+                            self.write(frame)
+
+                    for sink in self.sinks:
+                        if gov and not gov.due(sink):
+                            continue
+                        start = time.monotonic()
+                        cpu = time.process_time()
+                        sink.publish(data)
+                        if gov:
+                            gov.charge(sink, time.process_time() - cpu)
+                        if tr:
+                            tr.span(type(sink).__name__, start, cat="sink")
+
+                    # Send Data
+                    if not self.write(data):
+                        # If write failed, we are already disconnected by self.write()
+                        # Loop will handle reconnection next iteration
+                        pass
+
+                    # Occasional extra frames (history series) follow the stats frame
+                    for feed in self.feeds:
+                        for frame in feed.frames(now):
+                            self.write(frame)
 
             except KeyboardInterrupt:
                 print("Stopping...")
@@ -285,18 +445,168 @@ class SerialManager:
             except Exception as e:
                 print(f"Unexpected error in loop: {e}", file=sys.stderr)
                 time.sleep(1) # Prevent tight loop on error
-            
-            time.sleep(1.0)
-        
-        self.disconnect()
+
+def _terminate(signum, frame):
+    # systemctl stop / kill: unwind like Ctrl-C so every sink and source closes
+    raise KeyboardInterrupt
+
 
 def main():
+    signal.signal(signal.SIGTERM, _terminate)
     parser = argparse.ArgumentParser()
     parser.add_argument("--port", required=False, help="Serial port (auto-detect if not specified)")
     parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--interval", type=float, default=1.0, help="Seconds between frames")
+    parser.add_argument("--protocol", choices=SerialManager.PROTOCOLS, default="json",
+                        help="Stats frame encoding; ids sends registered metrics as one array "
+                             "(firmware built with the same metric_ids.h)")
+    parser.add_argument("--shm", nargs="?", const=DEFAULT_SHM_PATH, default=None,
+                        help=f"Publish each sample to a shared-memory file (default {DEFAULT_SHM_PATH})")
+    parser.add_argument("--metrics-port", type=int, default=None,
+                        help="Serve collected metrics for Prometheus on localhost:PORT/metrics")
+    parser.add_argument("--metrics-bind", default="127.0.0.1")
+    parser.add_argument("--agent", metavar="HOST:PORT", default=None,
+                        help="Stream samples to an aggregator instead of driving a display")
+    parser.add_argument("--aggregate", metavar="[BIND:]PORT", default=None,
+                        help="Accept agent streams and show a cluster page on the display")
+    parser.add_argument("--statsd", metavar="[BIND:]PORT", nargs="?", const="127.0.0.1:8125", default=None,
+                        help="Accept StatsD/DogStatsD metrics over UDP (default 127.0.0.1:8125)")
+    parser.add_argument("--statsd-unix", metavar="PATH", default=None,
+                        help="Also accept StatsD datagrams on a Unix socket")
+    parser.add_argument("--statsd-show", metavar="NAME[:AGG][=LABEL]", action="append", default=[],
+                        help="Show a pushed metric on the APP page (AGG: sum, rate, last, max, avg, count)")
+    parser.add_argument("--tails", metavar="FIELD,...", nargs="?", const="cpu.load,cpu.temp,gpu.gpu_temp",
+                        default=None, help="p50/p95/p99 over 1 and 15 min for the TAILS page "
+                                           "(statsd:NAME for pushed timers)")
+    parser.add_argument("--anomaly", action="store_true",
+                        help="Flag spikes, creeping trends and pinned cores on the display")
+    parser.add_argument("--probe", metavar="NAME=URL", action="append", default=[],
+                        help="Probe tcp://HOST:PORT, http://HOST:PORT/PATH or unix:///PATH[?send=TEXT] "
+                             "(repeatable; up/p99 on the APP page)")
+    parser.add_argument("--probe-interval", type=float, default=5.0, help="Seconds between probes")
+    parser.add_argument("--probe-timeout", type=float, default=1.0, help="Seconds before a probe counts as down")
+    parser.add_argument("--logs", metavar="PATH,...", default=None,
+                        help="Tail log files and count matching lines per minute (APP page, logs.NAME)")
+    parser.add_argument("--log-pattern", metavar="NAME=REGEX", action="append", default=[],
+                        help="Pattern counted in --logs (repeatable; default ERR and WARN)")
+    parser.add_argument("--energy", nargs="?", const=DEFAULT_ENERGY_PATH, default=None, metavar="STATE.json",
+                        help=f"Count CPU/DRAM/GPU energy with totals kept across restarts "
+                             f"(ENERGY page; default {DEFAULT_ENERGY_PATH})")
+    parser.add_argument("--alerts", metavar="RULES.json", default=None,
+                        help="Alert rules replacing the built-in cpu/gpu/ram/swap/disk thresholds")
+    parser.add_argument("--control", nargs="?", const=DEFAULT_CONTROL_PATH, default=None, metavar="SOCKET",
+                        help=f"Accept live reconfiguration on a Unix socket (default {DEFAULT_CONTROL_PATH}; "
+                             f"client: control.py)")
+    parser.add_argument("--trace", metavar="OUT.json", default=None,
+                        help="Record a host+device timeline in Chrome trace format")
+    parser.add_argument("--budget", type=float, default=None, metavar="PCT",
+                        help="CPU budget for the monitor in %% of one core; slows the costliest "
+                             "collectors, sources, sinks and samplers when exceeded")
+    parser.add_argument("--sched-idle", action="store_true", help="Run at SCHED_IDLE priority")
+    parser.add_argument("--nice", type=int, default=None, help="Lower the monitor's priority by N")
+    parser.add_argument("--mlock", action="store_true", help="Lock the monitor's memory (mlockall)")
+    parser.add_argument("--watch", metavar="NAME|PID|cgroup:PATH", default=None,
+                        help="Sample one service at high rate for the WATCH page")
+    parser.add_argument("--watch-hz", type=float, default=5.0)
+    parser.add_argument("--store", nargs="?", const=DEFAULT_STORE_PATH, default=None,
+                        help=f"Keep every sample in a memory-mapped ring file (default {DEFAULT_STORE_PATH})")
+    parser.add_argument("--store-hours", type=float, default=24.0, help="History kept in the ring store")
+    parser.add_argument("--history", metavar="FIELD", default="cpu.load",
+                        help="Metric graphed on the HISTORY page (requires --store)")
+    parser.add_argument("--history-span", type=float, default=3600, help="Seconds shown on the HISTORY page")
+    parser.add_argument("--archive", nargs="?", const=DEFAULT_ARCHIVE_PATH, default=None,
+                        help=f"Compress closed time blocks into a long-term archive (default {DEFAULT_ARCHIVE_PATH})")
+    parser.add_argument("--archive-block-hours", type=float, default=2.0)
     args = parser.parse_args()
+    apply_priority(args.sched_idle, args.nice, args.mlock)
+    # Prime the counters first so their interval overlaps the rest of start-up
+    host = host_collector()
+    
+    sinks = []
+    feeds = []
+    metrics = None
+    if args.shm:
+        from shm import ShmPublisher
+        sinks.append(ShmPublisher(args.shm))
+    if args.metrics_port is not None:
+        from metrics_http import MetricsServer
+        metrics = MetricsServer(args.metrics_port, bind=args.metrics_bind)
+        sinks.append(metrics)
+    if args.store:
+        from tsdb import RingStore, Rollups, HistoryFeed
+        capacity = max(1, int(args.store_hours * 3600 / args.interval))
+        sinks.append(RingStore(args.store, capacity=capacity, interval=args.interval))
+        rollups = Rollups(args.store, ring_path=args.store)
+        sinks.append(rollups)
+        feeds.append(HistoryFeed(rollups, args.history, args.history_span))
+    if args.archive:
+        from archive import Archiver
+        sinks.append(Archiver(args.archive, block_seconds=args.archive_block_hours * 3600))
+    if args.agent:
+        from agent import AgentClient, parse_addr
+        sinks.append(AgentClient(parse_addr(args.agent, "127.0.0.1")))
+    
+    sources = []
+    if args.aggregate:
+        from agent import Aggregator, parse_addr
+        sources.append(Aggregator(parse_addr(args.aggregate)))
+    if args.statsd or args.statsd_unix:
+        from agent import parse_addr
+        from statsd import StatsdListener
+        udp = parse_addr(args.statsd, "127.0.0.1") if args.statsd else None
+        sources.append(StatsdListener(udp, args.statsd_unix, show=args.statsd_show))
+    if args.probe:
+        from probes import ProbeRunner
+        sources.append(ProbeRunner(args.probe, args.probe_interval, args.probe_timeout))
+    
+    if args.tails:
+        from sketch import TailTracker
+        tails = TailTracker(args.tails.split(","))
+        for source in sources:
+            if hasattr(source, "tails"):
+                source.tails = tails
+        sources.append(tails)
+    if args.anomaly:
+        from anomaly import AnomalyMonitor
+        sources.append(AnomalyMonitor())
+    if args.logs:
+        from logtail import LogTail, parse_patterns
+        sources.append(LogTail(args.logs.split(","), parse_patterns(args.log_pattern)))
+    if args.energy:
+        from energy import EnergyMeter
+        sources.append(EnergyMeter(args.energy, host=host, metrics=metrics))
+    samplers = []
+    if args.watch:
+        from watch import WatchCollector
+        watch = WatchCollector(args.watch, hz=args.watch_hz)
+        samplers.append(watch)
+        sources.append(watch)
+
+    # Sample-to-pixel latency, from the device's echo of each frame id
+    latency = LatencyTracker()
+    sources.append(latency)
+    # Overhead is measured always (DEBUG page); --budget also throttles
+    # collectors, sources, sinks and samplers
+    governor = Governor(host, args.budget)
+    sources.append(governor)
+    # Rules run after every other source so they can refer to its fields
+    alerts = AlertEngine(load_rules(args.alerts) if args.alerts else DEFAULT_RULES)
+    sources.append(alerts)
     
-    manager = SerialManager(port=args.port, baud=args.baud)
+    # An agent without an explicit port has no display attached
+    headless = bool(args.agent) and not args.port
+    tracer = None
+    if args.trace:
+        from timeline import Tracer
+        tracer = Tracer(args.trace, latency.clock)
+    manager = SerialManager(port=args.port, baud=args.baud, sinks=sinks,
+                            sources=sources, samplers=samplers, feeds=feeds, priority=[alerts],
+                            headless=headless, tracer=tracer, latency=latency, interval=args.interval,
+                            ready_at=host.ready_at, protocol=args.protocol)
+    manager.governor = governor
+    if args.control:
+        from control import ControlServer
+        manager.control = ControlServer(args.control, manager, host, governor)
     manager.run()
 
 if __name__ == "__main__":
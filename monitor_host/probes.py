@@ -0,0 +1,301 @@
+"""Health and latency probes against local endpoints.
+
+    NAME=tcp://HOST:PORT             connect
+    NAME=http://HOST:PORT/PATH       GET, up on a 2xx/3xx status line
+    NAME=unix:///PATH                connect
+    NAME=unix:///PATH?send=TEXT      send TEXT + newline, up on the first reply bytes
+
+Probes run on one background thread around a selector. Every socket is
+non-blocking, so a hung endpoint costs a registered fd until its deadline and
+never holds up the sampling tick or the other probes. Host names are resolved
+once at start-up. A probe's latency is measured from socket creation to
+connect (tcp, plain unix) or to the first response bytes (http, unix with
+send).
+
+Each endpoint keeps a WindowedSketch of latencies over WINDOW seconds. The
+frame carries "probes": [{"n", "up", "ms", "p99"}], and each endpoint fills an
+APP page tile showing p99 in ms, or DOWN.
+"""
+import os
+import selectors
+import socket
+import sys
+import threading
+import time
+from urllib.parse import urlsplit, parse_qs
+
+from sketch import WindowedSketch
+
+DEFAULT_INTERVAL = 5.0
+DEFAULT_TIMEOUT = 1.0
+WINDOW = 300
+MAX_RESPONSE = 4096
+MAX_TILES = 4
+
+
+class Endpoint:
+    def __init__(self, spec):
+        name, sep, url = spec.partition("=")
+        if not sep or not name:
+            raise ValueError(f"probe {spec!r}: expected NAME=URL")
+        self.name = name
+        u = urlsplit(url)
+        self.kind = u.scheme
+        self.request = None
+        if u.scheme == "unix":
+            self.family = socket.AF_UNIX
+            self.addr = u.path
+            send = parse_qs(u.query).get("send")
+            if send:
+                self.request = send[0].encode() + b"\n"
+        elif u.scheme in ("tcp", "http"):
+            port = u.port or (80 if u.scheme == "http" else None)
+            if port is None:
+                raise ValueError(f"probe {name}: tcp needs a port")
+            # Resolved once: getaddrinfo blocks and local names do not move
+            family, _, _, _, addr = socket.getaddrinfo(u.hostname or "127.0.0.1", port,
+                                                       type=socket.SOCK_STREAM)[0]
+            self.family = family
+            self.addr = addr
+            if u.scheme == "http":
+                path = (u.path or "/") + ("?" + u.query if u.query else "")
+                self.request = (f"GET {path} HTTP/1.0\r\nHost: {u.netloc}\r\n"
+                                f"User-Agent: cyd-monitor\r\nConnection: close\r\n\r\n").encode()
+        else:
+            raise ValueError(f"probe {name}: unsupported scheme {u.scheme!r}")
+        self.sketch = WindowedSketch(WINDOW)
+        self.up = None
+        self.last_ms = None
+        self.error = ""
+        self.next_due = 0.0
+
+
+class _Attempt:
+    __slots__ = ("ep", "sock", "start", "deadline", "sent", "reply")
+
+    def __init__(self, ep, sock, start, deadline):
+        self.ep = ep
+        self.sock = sock
+        self.start = start
+        self.deadline = deadline
+        self.sent = 0
+        self.reply = b""
+
+
+class ProbeRunner:
+    """Source publishing probe state; the probing itself runs on a thread"""
+    name = "probes"
+
+    def __init__(self, specs, interval=DEFAULT_INTERVAL, timeout=DEFAULT_TIMEOUT):
+        self.endpoints = [Endpoint(s) for s in specs]
+        self.interval = interval
+        self.timeout = timeout
+        self.sel = selectors.DefaultSelector()
+        self.lock = threading.Lock()
+        self.wake_r, self.wake_w = os.pipe()
+        os.set_blocking(self.wake_r, False)
+        self.sel.register(self.wake_r, selectors.EVENT_READ)
+        self.attempts = {}
+        self.stopping = False
+        # Spread the first probes over the interval instead of firing together
+        start = time.monotonic()
+        for i, ep in enumerate(self.endpoints):
+            ep.next_due = start + interval * i / max(1, len(self.endpoints))
+        self.thread = threading.Thread(target=self._run, name="probes", daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        while not self.stopping:
+            now = time.monotonic()
+            for ep in self.endpoints:
+                if now >= ep.next_due and all(a.ep is not ep for a in self.attempts.values()):
+                    ep.next_due = max(ep.next_due + self.interval, now)
+                    self._start(ep, now)
+            wake = min([ep.next_due for ep in self.endpoints] +
+                       [a.deadline for a in self.attempts.values()])
+            for key, mask in self.sel.select(max(0.0, wake - time.monotonic())):
+                if key.fileobj == self.wake_r:
+                    continue
+                self._advance(self.attempts[key.fileobj], mask)
+            now = time.monotonic()
+            for attempt in [a for a in self.attempts.values() if now >= a.deadline]:
+                self._finish(attempt, now, "timeout")
+
+    def _start(self, ep, now):
+        sock = socket.socket(ep.family, socket.SOCK_STREAM)
+        sock.setblocking(False)
+        attempt = _Attempt(ep, sock, now, now + self.timeout)
+        try:
+            sock.connect(ep.addr)
+        except (BlockingIOError, InterruptedError):
+            pass
+        except OSError as e:
+            # Refused / missing socket file fail synchronously
+            self.attempts[sock] = attempt
+            self._finish(attempt, time.monotonic(), e.strerror or str(e))
+            return
+        self.attempts[sock] = attempt
+        self.sel.register(sock, selectors.EVENT_WRITE)
+
+    def _advance(self, attempt, mask):
+        sock = attempt.sock
+        ep = attempt.ep
+        now = time.monotonic()
+        try:
+            if mask & selectors.EVENT_WRITE:
+                if attempt.sent == 0:
+                    err = sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
+                    if err:
+                        self._finish(attempt, now, os.strerror(err))
+                        return
+                    if ep.request is None:
+                        self._finish(attempt, now, None)
+                        return
+                attempt.sent += sock.send(ep.request[attempt.sent:])
+                if attempt.sent == len(ep.request):
+                    self.sel.modify(sock, selectors.EVENT_READ)
+                return
+            chunk = sock.recv(MAX_RESPONSE)
+        except BlockingIOError:
+            return
+        except OSError as e:
+            self._finish(attempt, now, e.strerror or str(e))
+            return
+        if not chunk:
+            self._finish(attempt, now, "closed without a reply")
+            return
+        if ep.kind != "http":
+            self._finish(attempt, now, None)
+            return
+        attempt.reply = (attempt.reply + chunk)[:MAX_RESPONSE]
+        line, nl, _ = attempt.reply.partition(b"\r\n")
+        if not nl and len(attempt.reply) < MAX_RESPONSE:
+            return
+        parts = line.split()
+        status = parts[1] if len(parts) > 1 and parts[0].startswith(b"HTTP/") else b""
+        if status[:1] in (b"2", b"3"):
+            self._finish(attempt, now, None)
+        else:
+            self._finish(attempt, now, "HTTP " + (status.decode(errors="replace") or "garbage"))
+
+    def _finish(self, attempt, now, error):
+        del self.attempts[attempt.sock]
+        try:
+            self.sel.unregister(attempt.sock)
+        except KeyError:
+            pass
+        attempt.sock.close()
+        ep = attempt.ep
+        up = error is None
+        with self.lock:
+            if up:
+                ep.last_ms = (now - attempt.start) * 1000
+                ep.sketch.add(ep.last_ms, now)
+            if up != ep.up:
+                print(f"Probe {ep.name} {'up' if up else 'DOWN'}"
+                      + (f" ({ep.last_ms:.1f} ms)" if up else f" ({error})"))
+            ep.up = up
+            ep.error = error or ""
+
+    def contribute(self, data):
+        now = time.monotonic()
+        rows = []
+        with self.lock:
+            for ep in self.endpoints:
+                if ep.up is None:
+                    continue
+                p99 = ep.sketch.merged(now).quantile(0.99)
+                rows.append({"n": ep.name, "up": int(ep.up),
+                             "ms": round(ep.last_ms, 1) if ep.last_ms is not None else None,
+                             "p99": round(p99, 1) if p99 is not None else None})
+        if not rows:
+            return
+        data["probes"] = rows
+        custom = data.setdefault("custom", [])
+        for row in rows[:MAX_TILES - len(custom)]:
+            custom.append({"n": row["n"][:8], "v": row["p99"], "d": int(not row["up"])})
+
+    def close(self):
+        self.stopping = True
+        os.write(self.wake_w, b"x")
+        self.thread.join(timeout=2)
+        for attempt in list(self.attempts.values()):
+            attempt.sock.close()
+        self.sel.close()
+        os.close(self.wake_r)
+        os.close(self.wake_w)
+
+
+if __name__ == "__main__":
+    # Local stand-in servers: a slow HTTP service, a unix echo socket, a port
+    # nothing listens on and an HTTP handler that outlives the timeout
+    import http.server
+    import tempfile
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path == "/hang":
+                time.sleep(3)
+            else:
+                time.sleep(0.002)
+            self.send_response(500 if self.path == "/fail" else 200)
+            self.end_headers()
+
+        def log_message(self, *args):
+            pass
+
+    httpd = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+    threading.Thread(target=httpd.serve_forever, daemon=True).start()
+    port = httpd.server_address[1]
+
+    sock_path = os.path.join(tempfile.mkdtemp(prefix="cyd-probe-"), "echo.sock")
+    echo = socket.socket(socket.AF_UNIX)
+    echo.bind(sock_path)
+    echo.listen()
+
+    def serve_echo():
+        while True:
+            conn, _ = echo.accept()
+            conn.sendall(conn.recv(64))
+            conn.close()
+    threading.Thread(target=serve_echo, daemon=True).start()
+
+    closed = socket.socket()
+    closed.bind(("127.0.0.1", 0))
+    closed_port = closed.getsockname()[1]
+    closed.close()
+
+    runner = ProbeRunner([f"web=http://127.0.0.1:{port}/health", f"tcp=tcp://127.0.0.1:{port}",
+                          f"echo=unix://{sock_path}?send=PING", f"gone=tcp://127.0.0.1:{closed_port}",
+                          f"err=http://127.0.0.1:{port}/fail", f"hang=http://127.0.0.1:{port}/hang"],
+                         interval=0.2, timeout=0.5)
+    # The sampling tick keeps its pace while probes are in flight
+    worst = 0.0
+    frame = {}
+    for _ in range(40):
+        start = time.perf_counter()
+        frame = {}
+        runner.contribute(frame)
+        worst = max(worst, time.perf_counter() - start)
+        time.sleep(0.05)
+    rows = {row["n"]: row for row in frame["probes"]}
+    for row in rows.values():
+        print(f"  {row['n']:5} up={row['up']} last={row['ms']} ms p99={row['p99']} ms")
+    print(f"slowest contribute() {worst * 1e6:.0f} us")
+    assert sorted(rows) == ["echo", "err", "gone", "hang", "tcp", "web"], sorted(rows)
+    for name in ("web", "tcp", "echo"):
+        row = rows[name]
+        assert row["up"] == 1, row
+        # Every probe of these answers well inside the timeout
+        assert 0 <= row["ms"] < 500 and 0 <= row["p99"] < 500, row
+    for name in ("gone", "err", "hang"):
+        assert rows[name]["up"] == 0 and rows[name]["ms"] is None, rows[name]
+    # Down endpoints show as flagged tiles, in probe order up to MAX_TILES
+    tiles = [("web", 0), ("tcp", 0), ("echo", 0), ("gone", 1), ("err", 1), ("hang", 1)][:MAX_TILES]
+    assert [(t["n"], t["d"]) for t in frame["custom"]] == tiles, frame["custom"]
+    # contribute() only reads results; a probe blocking the tick would cost
+    # up to the 0.5 s timeout here
+    assert worst < 0.05, f"contribute() took {worst * 1e3:.1f} ms"
+    runner.close()
+    httpd.shutdown()
+    os.unlink(sock_path)
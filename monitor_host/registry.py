@@ -0,0 +1,227 @@
+"""Metric registry: one dense integer ID per metric, shared by every stage.
+
+A metric's ID is its position in METRICS. Each entry has the metric's path in
+the stats frame, a unit and a wire scale. The same IDs index:
+
+    flat(data)       the frame's registered values as one array('d') (NaN
+                     when missing); inside the sampling loop's `with tick(data)`
+                     the walk happens once per tick however many stages ask
+    reader(fields)   a function returning the values of a field list: an
+                     index pick from flat() when every field is registered,
+                     else a walk of the paths (log rates, StatsD timers ...)
+    the shm file, ring store, rollups, archive, metrics endpoint, agent
+    stream, anomaly detectors and alert rules (through reader)
+    the "ids" wire protocol: {"v": [value * scale rounded, or null, ...],
+                     "rv": VERSION} replaces the nested cpu/ram/swap/gpu/
+                     disk/net objects
+    the firmware     float metric[METRIC_COUNT] indexed by the generated
+                     monitor_firmware/src/metric_ids.h
+
+Changing METRICS means regenerating the header and reflashing:
+
+    python3 registry.py --header ../monitor_firmware/src/metric_ids.h
+
+VERSION is a CRC of the names and scales. The device ignores "v" arrays from a
+registry it was not built with, and the JSON protocol keeps working either way.
+Files written by the shm, ring and archive sinks name their columns, so old
+files stay readable after the list changes.
+"""
+import collections
+import contextlib
+import math
+import operator
+import re
+import sys
+import zlib
+from array import array
+
+MAX_CORES = 16
+
+Metric = collections.namedtuple("Metric", "name unit scale")
+
+METRICS = [
+    Metric("cpu.load", "%", 10),
+    Metric("cpu.temp", "C", 10),
+    Metric("cpu.freq", "MHz", 1),
+    Metric("cpu.pwr", "W", 10),
+    Metric("cpu.fan", "rpm", 1),
+] + [Metric(f"cpu.cores.{i}", "%", 10) for i in range(MAX_CORES)] + [
+    Metric("ram.used", "GiB", 10),
+    Metric("ram.total", "GiB", 10),
+    Metric("ram.p", "%", 10),
+    Metric("swap.used", "GiB", 10),
+    Metric("swap.p", "%", 10),
+    Metric("gpu.gpu_load", "%", 1),
+    Metric("gpu.vram_used", "MiB", 10),
+    Metric("gpu.vram_total", "MiB", 10),
+    Metric("gpu.vram_p", "%", 10),
+    Metric("gpu.gpu_temp", "C", 1),
+    Metric("gpu.gpu_pwr", "W", 10),
+    Metric("gpu.gpu_fan", "%", 1),
+    Metric("disk.p", "%", 10),
+    # Totals since boot, not rates
+    Metric("net.sent", "MiB", 10),
+    Metric("net.recv", "MiB", 10),
+]
+
+NAMES = [m.name for m in METRICS]
+ID = {name: i for i, name in enumerate(NAMES)}
+COUNT = len(METRICS)
+SCALES = [m.scale for m in METRICS]
+# Top-level frame keys made up entirely of registered metrics
+ROOTS = tuple(dict.fromkeys(name.split(".", 1)[0] for name in NAMES))
+VERSION = zlib.crc32(" ".join(f"{m.name}:{m.scale}" for m in METRICS).encode())
+
+
+def compile_getters(fields):
+    getters = []
+    for name in fields:
+        getters.append(tuple(int(p) if p.isdigit() else p for p in name.split(".")))
+    return getters
+
+
+def flatten(data, getters, out=None):
+    """Walk each field path in the nested stats dict, NaN when absent"""
+    if out is None:
+        out = [math.nan] * len(getters)
+    for i, path in enumerate(getters):
+        node = data
+        try:
+            for key in path:
+                node = node[key]
+            out[i] = float(node)
+        except (KeyError, IndexError, TypeError, ValueError):
+            out[i] = math.nan
+    return out
+
+
+_getters = compile_getters(NAMES)
+_values = array("d", [math.nan] * COUNT)
+# Frame of the tick in progress; None outside a tick
+_frame = None
+
+
+@contextlib.contextmanager
+def tick(data):
+    """Share one walk of this frame between every stage of a tick.
+
+    Inside the block flat(data) returns the array filled on entry (copy what
+    must be kept); it is dropped on exit, so a frame changed later, or a dict
+    reused for the next sample, is walked again.
+    """
+    global _frame
+    flatten(data, _getters, _values)
+    _frame = data
+    try:
+        yield _values
+    finally:
+        _frame = None
+
+
+def flat(data):
+    """Registered values of this frame by ID"""
+    if data is _frame:
+        return _values
+    return array("d", flatten(data, _getters))
+
+
+def reader(fields):
+    """data -> values of fields, in order"""
+    fields = list(fields)
+    ids = [ID.get(f) for f in fields]
+    if None in ids:
+        getters = compile_getters(fields)
+        return lambda data: flatten(data, getters)
+    if ids == list(range(COUNT)):
+        return flat
+    if len(ids) == 1:
+        i = ids[0]
+        return lambda data: (flat(data)[i],)
+    pick = operator.itemgetter(*ids)
+    return lambda data: pick(flat(data))
+
+
+def encode(values):
+    """Scaled integers for the wire; None for missing values"""
+    return [None if v != v else round(v * s) for v, s in zip(values, SCALES)]
+
+
+def wire_frame(data):
+    """The "ids" form of a stats frame: registered metrics as one array"""
+    frame = {k: v for k, v in data.items() if k not in ROOTS}
+    frame["v"] = encode(flat(data))
+    frame["rv"] = VERSION
+    return frame
+
+
+def header():
+    """C header for the firmware"""
+    lines = [
+        "// Generated by monitor_host/registry.py --header; do not edit.",
+        "#pragma once",
+        "",
+        "#include <stdint.h>",
+        "",
+        f"#define METRIC_REGISTRY_VERSION {VERSION}UL",
+        f"#define METRIC_MAX_CORES {MAX_CORES}",
+        "",
+        "enum MetricId {",
+    ]
+    for m in METRICS:
+        ident = "M_" + re.sub(r"[^A-Z0-9]", "_", m.name.upper())
+        lines.append(f"  {ident}, // {m.unit}")
+    lines += [
+        "  METRIC_COUNT",
+        "};",
+        "",
+        "// Wire values are value * scale, rounded",
+        "static const uint16_t METRIC_SCALE[METRIC_COUNT] = {",
+    ]
+    for i in range(0, COUNT, 12):
+        lines.append("    " + ", ".join(str(s) for s in SCALES[i:i + 12]) + ",")
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Metric registry")
+    parser.add_argument("--header", metavar="PATH", help="Write the firmware header")
+    parser.add_argument("--check", metavar="PATH", help="Exit 1 when the header at PATH is out of date")
+    parser.add_argument("--self-test", action="store_true", help="Check flat(), reader() and encode()")
+    args = parser.parse_args()
+    if args.self_test:
+        sample = {"cpu": {"load": 10.0, "cores": [1.0, 2.0]}, "ram": {"p": 40.0}}
+        load, core1 = reader(["cpu.load", "cpu.cores.1"]), reader(["cpu.cores.1"])
+        assert flat(sample)[ID["cpu.load"]] == 10.0
+        # A dict updated in place is read afresh, in a tick and after it
+        sample["cpu"]["load"] = 90.0
+        assert flat(sample)[ID["cpu.load"]] == 90.0, "stale value after an in-place update"
+        with tick(sample) as values:
+            assert flat(sample) is values and load(sample) == (90.0, 2.0)
+        sample["cpu"]["load"] = 55.5
+        sample["cpu"]["cores"][1] = 7.0
+        assert load(sample) == (55.5, 7.0) and core1(sample) == (7.0,)
+        with tick(sample):
+            assert load(sample) == (55.5, 7.0)
+        assert math.isnan(flat({})[0]) and encode(flat(sample))[ID["ram.p"]] == 400
+        assert encode(flat(sample))[ID["gpu.gpu_load"]] is None
+        print("registry self-test passed")
+        sys.exit(0)
+    if args.header:
+        with open(args.header, "w") as f:
+            f.write(header())
+        print(f"Wrote {COUNT} metric IDs to {args.header} (version {VERSION})")
+    elif args.check:
+        try:
+            with open(args.check) as f:
+                current = f.read() == header()
+        except OSError:
+            current = False
+        if not current:
+            print(f"{args.check} is out of date; regenerate with --header", file=sys.stderr)
+        sys.exit(0 if current else 1)
+    else:
+        for i, m in enumerate(METRICS):
+            print(f"{i:3}  {m.name:18} {m.unit:4} x{m.scale}")
+        print(f"version {VERSION}")
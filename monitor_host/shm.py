@@ -0,0 +1,201 @@
+"""Shared-memory publication of the latest sample.
+
+The writer maps a small fixed-layout file (by default under /dev/shm) and
+updates it once per tick under a seqlock. Readers map the same file and copy
+the values out without any syscall per read (a reader stats the path once
+per REMAP_CHECK to notice a restarted publisher):
+
+    offset 0   magic "CYDS", u16 version, u16 field count
+    offset 8   u32 sequence (odd while a write is in progress)
+    offset 16  f64 sample timestamp (unix seconds)
+    offset 64  field names, NAME_LEN bytes each, NUL padded
+    after      f64 values in field order (NaN when missing)
+
+The default fields are the metric registry in ID order, so the value at
+index i is metric ID i.
+"""
+import math
+import mmap
+import os
+import struct
+import sys
+import time
+
+from registry import NAMES, reader
+
+DEFAULT_SHM_PATH = "/dev/shm/cyd-monitor"
+
+MAGIC = b"CYDS"
+VERSION = 1
+NAME_LEN = 24
+HEADER = struct.Struct("<4sHH")
+SEQ = struct.Struct("<I")
+TS = struct.Struct("<d")
+SEQ_OFF = 8
+TS_OFF = 16
+NAMES_OFF = 64
+# Seconds between checks that a reader still maps the published file
+REMAP_CHECK = 1.0
+
+
+def _values_offset(count):
+    end = NAMES_OFF + count * NAME_LEN
+    return (end + 7) & ~7
+
+
+class ShmPublisher:
+    def __init__(self, path=DEFAULT_SHM_PATH, fields=NAMES):
+        self.path = path
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.values = struct.Struct(f"<{len(self.fields)}d")
+        self.values_off = _values_offset(len(self.fields))
+        self.size = self.values_off + self.values.size
+        self.seq = 0
+
+        # Build the header in a temp file and rename it into place so a reader
+        # never maps a half-initialised layout
+        tmp = f"{path}.{os.getpid()}.tmp"
+        fd = os.open(tmp, os.O_RDWR | os.O_CREAT | os.O_TRUNC, 0o644)
+        try:
+            os.ftruncate(fd, self.size)
+            self.mm = mmap.mmap(fd, self.size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        HEADER.pack_into(self.mm, 0, MAGIC, VERSION, len(self.fields))
+        for i, name in enumerate(self.fields):
+            self.mm[NAMES_OFF + i * NAME_LEN:NAMES_OFF + (i + 1) * NAME_LEN] = \
+                name.encode()[:NAME_LEN - 1].ljust(NAME_LEN, b"\0")
+        self.values.pack_into(self.mm, self.values_off, *([math.nan] * len(self.fields)))
+        os.replace(tmp, path)
+        print(f"Publishing samples to {path}")
+
+    def publish(self, data, ts=None):
+        """Write one sample under the seqlock"""
+        self.write_values(self.read(data), ts)
+
+    def write_values(self, values, ts=None):
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        SEQ.pack_into(self.mm, SEQ_OFF, self.seq)
+        TS.pack_into(self.mm, TS_OFF, time.time() if ts is None else ts)
+        self.values.pack_into(self.mm, self.values_off, *values)
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        SEQ.pack_into(self.mm, SEQ_OFF, self.seq)
+
+    def close(self):
+        try:
+            self.mm.close()
+            os.unlink(self.path)
+        except (OSError, ValueError):
+            pass
+
+
+class ShmReader:
+    """Read-only view of the latest published sample.
+
+    The publisher replaces the file when it starts, so a long-lived reader
+    compares the inode it has mapped with the path every REMAP_CHECK seconds
+    and remaps after a daemon restart instead of serving the old sample.
+    """
+
+    def __init__(self, path=DEFAULT_SHM_PATH):
+        self.path = path
+        self.mm = None
+        self._map()
+
+    def _map(self):
+        with open(self.path, "rb") as f:
+            mm = mmap.mmap(f.fileno(), 0, mmap.MAP_SHARED, mmap.PROT_READ)
+            ino = os.fstat(f.fileno()).st_ino
+        magic, version, count = HEADER.unpack_from(mm, 0)
+        if magic != MAGIC or version != VERSION:
+            mm.close()
+            raise ValueError(f"{self.path}: not a CYD shared-memory sample (version {version})")
+        self.fields = []
+        for i in range(count):
+            raw = mm[NAMES_OFF + i * NAME_LEN:NAMES_OFF + (i + 1) * NAME_LEN]
+            self.fields.append(raw.split(b"\0", 1)[0].decode())
+        self.index = {name: i for i, name in enumerate(self.fields)}
+        self.values = struct.Struct(f"<{count}d")
+        self.values_off = _values_offset(count)
+        if self.mm is not None:
+            self.mm.close()
+        self.mm = mm
+        self.ino = ino
+        self.next_check = time.monotonic() + REMAP_CHECK
+
+    def _check_replaced(self, now):
+        self.next_check = now + REMAP_CHECK
+        try:
+            if os.stat(self.path).st_ino == self.ino:
+                return
+            self._map()
+        except (OSError, ValueError):
+            # Publisher stopped or mid-restart: keep the old mapping for now
+            pass
+
+    def read(self, max_spins=1000):
+        """Return (timestamp, values) from a consistent snapshot"""
+        now = time.monotonic()
+        if now >= self.next_check:
+            self._check_replaced(now)
+        mm = self.mm
+        for _ in range(max_spins):
+            seq = SEQ.unpack_from(mm, SEQ_OFF)[0]
+            if seq & 1:
+                continue
+            ts = TS.unpack_from(mm, TS_OFF)[0]
+            values = self.values.unpack_from(mm, self.values_off)
+            if SEQ.unpack_from(mm, SEQ_OFF)[0] == seq:
+                return ts, values
+        raise TimeoutError("writer held the seqlock for too long")
+
+    def read_dict(self):
+        ts, values = self.read()
+        return ts, dict(zip(self.fields, values))
+
+    def get(self, name):
+        return self.read()[1][self.index[name]]
+
+    def close(self):
+        self.mm.close()
+
+
+def _bench(path, seconds=2.0):
+    reader = ShmReader(path)
+    n = 0
+    start = time.perf_counter()
+    deadline = start + seconds
+    while True:
+        for _ in range(1000):
+            reader.read()
+        n += 1000
+        now = time.perf_counter()
+        if now >= deadline:
+            break
+    elapsed = now - start
+    print(f"{n} reads in {elapsed:.2f}s: {elapsed / n * 1e6:.2f} us/read ({len(reader.fields)} fields)")
+
+
+def main():
+    import argparse
+    parser = argparse.ArgumentParser(description="Print the latest sample published by monitor.py --shm")
+    parser.add_argument("fields", nargs="*", help="Only print these fields (e.g. cpu.load gpu.gpu_temp)")
+    parser.add_argument("--path", default=DEFAULT_SHM_PATH)
+    parser.add_argument("--bench", action="store_true", help="Measure read cost instead of printing")
+    args = parser.parse_args()
+
+    if args.bench:
+        _bench(args.path)
+        return
+
+    reader = ShmReader(args.path)
+    ts, sample = reader.read_dict()
+    if time.time() - ts > 5:
+        print(f"warning: sample is {time.time() - ts:.0f}s old", file=sys.stderr)
+    for name in args.fields or reader.fields:
+        print(f"{name}={sample[name]:g}")
+
+
+if __name__ == "__main__":
+    main()
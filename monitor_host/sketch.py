@@ -0,0 +1,200 @@
+"""Mergeable streaming quantile sketches for per-metric percentiles.
+
+DDSketch-style: values map to logarithmic buckets with a fixed relative
+accuracy, so a sample is one log and one dict increment, and two sketches
+merge by adding counts. The bucket count is capped by collapsing the lowest
+buckets, which keeps the upper percentiles (the tail we care about) exact to
+the configured accuracy while bounding memory per metric.
+
+Sliding windows are a ring of sub-window sketches; quantiles merge the live
+slices, so expiring old data never requires storing raw samples.
+"""
+import math
+import time
+
+from registry import reader
+
+DEFAULT_ACCURACY = 0.01
+DEFAULT_MAX_BINS = 512
+DEFAULT_WINDOWS = (60, 900)
+SLICES = 6
+QUANTILES = (0.5, 0.95, 0.99)
+MAX_TAIL_ROWS = 6
+
+
+class DDSketch:
+    def __init__(self, accuracy=DEFAULT_ACCURACY, max_bins=DEFAULT_MAX_BINS):
+        self.accuracy = accuracy
+        self.gamma = (1 + accuracy) / (1 - accuracy)
+        self.log_gamma = math.log(self.gamma)
+        self.max_bins = max_bins
+        self.pos = {}
+        self.neg = {}
+        self.zeros = 0
+        self.count = 0
+        self.min = math.inf
+        self.max = -math.inf
+
+    def add(self, value, weight=1):
+        if value != value:
+            return
+        if value > 0:
+            store = self.pos
+            key = math.ceil(math.log(value) / self.log_gamma)
+        elif value < 0:
+            store = self.neg
+            key = math.ceil(math.log(-value) / self.log_gamma)
+        else:
+            self.zeros += weight
+            store = None
+        if store is not None:
+            store[key] = store.get(key, 0) + weight
+            if len(store) > self.max_bins:
+                self._collapse(store)
+        self.count += weight
+        if value < self.min:
+            self.min = value
+        if value > self.max:
+            self.max = value
+
+    def _collapse(self, store):
+        """Fold the lowest-magnitude buckets together to respect max_bins"""
+        keys = sorted(store)
+        # For negatives the smallest magnitude is the value nearest zero,
+        # which is also the lowest key; collapsing it keeps the tails exact
+        excess = len(keys) - self.max_bins + 1
+        merged = sum(store.pop(k) for k in keys[:excess])
+        store[keys[excess]] = store.get(keys[excess], 0) + merged
+
+    def merge(self, other):
+        for k, c in other.pos.items():
+            self.pos[k] = self.pos.get(k, 0) + c
+        for k, c in other.neg.items():
+            self.neg[k] = self.neg.get(k, 0) + c
+        self.zeros += other.zeros
+        self.count += other.count
+        self.min = min(self.min, other.min)
+        self.max = max(self.max, other.max)
+        for store in (self.pos, self.neg):
+            while len(store) > self.max_bins:
+                self._collapse(store)
+
+    def _value(self, key):
+        return 2 * self.gamma ** key / (self.gamma + 1)
+
+    def _ordered(self):
+        """(representative value, count) from lowest to highest"""
+        for key in sorted(self.neg, reverse=True):
+            yield max(-self._value(key), self.min), self.neg[key]
+        if self.zeros:
+            yield 0.0, self.zeros
+        for key in sorted(self.pos):
+            yield min(self._value(key), self.max), self.pos[key]
+
+    def quantiles(self, qs=QUANTILES):
+        """Several (ascending) quantiles in one pass over the buckets"""
+        if self.count == 0:
+            return [None] * len(qs)
+        out = []
+        ranks = [q * (self.count - 1) for q in qs]
+        seen = 0
+        it = self._ordered()
+        value = None
+        for rank in ranks:
+            while seen <= rank:
+                try:
+                    value, c = next(it)
+                except StopIteration:
+                    value = self.max
+                    break
+                seen += c
+            out.append(value)
+        return out
+
+    def quantile(self, q):
+        return self.quantiles((q,))[0]
+
+
+class WindowedSketch:
+    """Sliding window made of SLICES rotating sub-sketches"""
+
+    def __init__(self, window, slices=SLICES, **kw):
+        self.window = window
+        self.slice_len = window / slices
+        self.kw = kw
+        self.slices = [DDSketch(**kw) for _ in range(slices)]
+        self.starts = [-math.inf] * slices
+        self.current = 0
+
+    def _rotate(self, now):
+        start = now - now % self.slice_len
+        if self.starts[self.current] == start:
+            return
+        # Move to the next slice, reusing the oldest one
+        self.current = (self.current + 1) % len(self.slices)
+        self.slices[self.current] = DDSketch(**self.kw)
+        self.starts[self.current] = start
+
+    def add(self, value, now=None):
+        now = time.monotonic() if now is None else now
+        self._rotate(now)
+        self.slices[self.current].add(value)
+
+    def merged(self, now=None):
+        now = time.monotonic() if now is None else now
+        out = DDSketch(**self.kw)
+        for sk, start in zip(self.slices, self.starts):
+            if start > now - self.window:
+                out.merge(sk)
+        return out
+
+
+class TailTracker:
+    """Source keeping windowed sketches per metric and adding percentiles to the frame"""
+    name = "tails"
+
+    def __init__(self, fields, windows=DEFAULT_WINDOWS):
+        self.fields = [f for f in fields if not f.startswith("statsd:")]
+        self.read = reader(self.fields)
+        self.windows = list(windows)
+        names = self.fields + [f[7:] for f in fields if f.startswith("statsd:")]
+        self.sketches = {name: [WindowedSketch(w) for w in self.windows] for name in names}
+
+    def observe(self, name, value, now=None):
+        """Feed one raw observation (used for pushed StatsD timers)"""
+        for sk in self.sketches.get(name, ()):
+            sk.add(value, now)
+
+    def contribute(self, data):
+        now = time.monotonic()
+        for name, value in zip(self.fields, self.read(data)):
+            self.observe(name, value, now)
+        rows = []
+        for name, sketches in self.sketches.items():
+            for w, sk in zip(self.windows, sketches):
+                p = sk.merged(now).quantiles()
+                if p[0] is None:
+                    continue
+                rows.append({"n": name[:10], "w": w, "p": [round(v, 1) for v in p]})
+        if rows:
+            data["tails"] = rows[:MAX_TAIL_ROWS]
+
+    def close(self):
+        pass
+
+
+if __name__ == "__main__":
+    import random
+    sk = DDSketch()
+    n = 200000
+    data = [random.lognormvariate(3, 1) for _ in range(n)]
+    start = time.perf_counter()
+    for v in data:
+        sk.add(v)
+    add_us = (time.perf_counter() - start) / n * 1e6
+    data.sort()
+    for q in QUANTILES:
+        exact = data[int(q * (n - 1))]
+        est = sk.quantile(q)
+        print(f"p{q * 100:g}: exact {exact:.3f} sketch {est:.3f} err {abs(est - exact) / exact * 100:.2f}%")
+    print(f"{add_us:.2f} us/add, {len(sk.pos)} buckets")
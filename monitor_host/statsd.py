@@ -0,0 +1,233 @@
+"""Local StatsD / DogStatsD ingest for application metrics.
+
+Packets are drained from non-blocking UDP and Unix datagram sockets at the
+start of every tick, so aggregation happens on the main loop without locks or
+a receiver thread; the kernel socket buffer absorbs bursts between ticks.
+Memory is bounded by MAX_METRICS; names beyond that are counted and dropped.
+
+    api.requests:1|c            counter  -> sum, rate per second
+    queue.depth:42|g            gauge    -> last, max (persists across ticks)
+    db.latency:12.5|ms|@0.1     timer    -> last, max, avg
+    web.hits:1|c|#env:prod      DogStatsD tags are accepted and ignored
+"""
+import os
+import socket
+import sys
+import time
+
+from control import remove_stale
+
+DEFAULT_UDP = ("127.0.0.1", 8125)
+MAX_METRICS = 512
+MAX_PACKETS_PER_TICK = 20000
+MAX_CUSTOM_SLOTS = 4
+RCVBUF = 1 << 20
+
+KIND_COUNTER = 0
+KIND_GAUGE = 1
+KIND_TIMER = 2
+KINDS = {b"c": KIND_COUNTER, b"g": KIND_GAUGE, b"ms": KIND_TIMER, b"h": KIND_TIMER, b"d": KIND_TIMER}
+
+AGGREGATES = ("sum", "rate", "last", "max", "avg", "count")
+
+
+class _Metric:
+    __slots__ = ("kind", "sum", "count", "last", "max", "tick_sum", "tick_count", "tick_max", "rate")
+
+    def __init__(self, kind):
+        self.kind = kind
+        self.sum = 0.0
+        self.count = 0
+        self.last = 0.0
+        self.max = 0.0
+        self.rate = 0.0
+        self.tick_sum = 0.0
+        self.tick_count = 0
+        self.tick_max = float("-inf")
+
+
+class StatsdListener:
+    """Source that aggregates pushed metrics once per tick"""
+    name = "statsd"
+
+    def __init__(self, udp_addr=DEFAULT_UDP, unix_path=None, show=()):
+        self.socks = []
+        if udp_addr:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, RCVBUF)
+            sock.bind(udp_addr)
+            sock.setblocking(False)
+            self.socks.append(sock)
+            self.port = sock.getsockname()[1]
+            print(f"StatsD listening on udp {udp_addr[0]}:{self.port}")
+        self.unix_path = unix_path
+        if unix_path:
+            remove_stale(unix_path, socket.SOCK_DGRAM)
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, RCVBUF)
+            sock.bind(unix_path)
+            sock.setblocking(False)
+            self.socks.append(sock)
+            print(f"StatsD listening on unix {unix_path}")
+        self.metrics = {}
+        self.dropped = 0
+        self.bad = 0
+        self.last_tick = time.monotonic()
+        self.show = [parse_show(s) for s in show][:MAX_CUSTOM_SLOTS]
+        # Optional TailTracker receiving every raw timer observation
+        self.tails = None
+
+    def drain(self):
+        """Read every queued datagram without blocking"""
+        for sock in self.socks:
+            for _ in range(MAX_PACKETS_PER_TICK):
+                try:
+                    packet = sock.recv(65535)
+                except (BlockingIOError, InterruptedError):
+                    break
+                except OSError:
+                    break
+                for line in packet.split(b"\n"):
+                    if line:
+                        self._ingest(line)
+
+    def _ingest(self, line):
+        try:
+            name, _, rest = line.partition(b":")
+            parts = rest.split(b"|")
+            value = float(parts[0])
+            kind = KINDS[parts[1]]
+            if kind == KIND_COUNTER:
+                for p in parts[2:]:
+                    if p.startswith(b"@"):
+                        value /= float(p[1:])
+        except (ValueError, IndexError, KeyError, ZeroDivisionError):
+            self.bad += 1
+            return
+        m = self.metrics.get(name)
+        if m is None:
+            if len(self.metrics) >= MAX_METRICS:
+                self.dropped += 1
+                return
+            m = self.metrics[name] = _Metric(kind)
+        if kind == KIND_GAUGE and parts[0][:1] in (b"+", b"-"):
+            # "+N"/"-N" gauges are deltas in the StatsD protocol
+            value = m.last + value
+        m.tick_sum += value
+        m.tick_count += 1
+        if value > m.tick_max:
+            m.tick_max = value
+        m.last = value
+        if kind == KIND_TIMER and self.tails is not None:
+            self.tails.observe(name.decode(errors="replace"), value)
+
+    def tick(self):
+        """Close the current aggregation window"""
+        now = time.monotonic()
+        dt = max(now - self.last_tick, 1e-3)
+        self.last_tick = now
+        for m in self.metrics.values():
+            m.sum = m.tick_sum
+            m.count = m.tick_count
+            m.rate = m.tick_sum / dt
+            if m.tick_count:
+                m.max = m.tick_max
+            elif m.kind != KIND_GAUGE:
+                m.max = 0.0
+            m.tick_sum = 0.0
+            m.tick_count = 0
+            m.tick_max = float("-inf")
+
+    def value(self, name, agg):
+        m = self.metrics.get(name.encode())
+        if m is None:
+            return None
+        if agg == "avg":
+            return m.sum / m.count if m.count else (m.last if m.kind == KIND_GAUGE else 0.0)
+        return getattr(m, agg)
+
+    def contribute(self, data):
+        self.drain()
+        self.tick()
+        custom = []
+        for name, agg, label in self.show:
+            v = self.value(name, agg)
+            custom.append({"n": label, "v": round(v, 2) if v is not None else None})
+        if custom:
+            data["custom"] = custom
+
+    def close(self):
+        for sock in self.socks:
+            sock.close()
+        if self.unix_path:
+            try:
+                os.unlink(self.unix_path)
+            except OSError:
+                pass
+
+
+def parse_show(spec):
+    """'name[:agg][=label]' -> (name, agg, label)"""
+    spec, _, label = spec.partition("=")
+    name, _, agg = spec.rpartition(":")
+    if not name or agg not in AGGREGATES:
+        name, agg = spec, None
+    if agg is None:
+        agg = "last"
+    return name, agg, (label or name.rsplit(".", 1)[-1])[:8]
+
+
+if __name__ == "__main__":
+    import tempfile
+    sock_dir = tempfile.mkdtemp(prefix="cyd-statsd-")
+    sock_path = os.path.join(sock_dir, "statsd.sock")
+    # A socket file left by a crashed listener is replaced
+    stale = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    stale.bind(sock_path)
+    stale.close()
+    listener = StatsdListener(("127.0.0.1", 0), sock_path, show=["api.req:rate=REQ/s", "queue:max"])
+    # ... a live one, or a file that is not a socket, is left alone
+    for path in (sock_path, os.path.join(sock_dir, "notes.txt")):
+        if not path.endswith(".sock"):
+            open(path, "w").close()
+        try:
+            StatsdListener(None, path)
+            raise AssertionError(f"{path} was replaced")
+        except OSError:
+            assert os.path.exists(path)
+
+    out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    n = 20000
+    start = time.perf_counter()
+    for i in range(n):
+        out.sendto(b"api.req:1|c\nqueue:%d|g" % (i % 50), ("127.0.0.1", listener.port))
+        # Drain as the loop would, before the receive buffer overflows
+        if i % 500 == 499:
+            listener.drain()
+    frame = {}
+    listener.contribute(frame)
+    elapsed = time.perf_counter() - start
+    print(f"{n} packets sent+aggregated in {elapsed * 1000:.1f} ms, dropped={listener.dropped}")
+    print(frame)
+    assert listener.value("api.req", "sum") == n and listener.value("api.req", "count") == n
+    assert listener.value("queue", "max") == 49 and listener.value("queue", "last") == (n - 1) % 50
+    assert [c["n"] for c in frame["custom"]] == ["REQ/s", "queue"] and frame["custom"][1]["v"] == 49.0
+    assert frame["custom"][0]["v"] > 0
+
+    # Sample rates, gauge deltas, timers and malformed lines over the unix socket
+    unix = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    unix.sendto(b"api.req:1|c|@0.5\nqueue:+3|g\nqueue:-1|g\ndb:10|ms\ndb:30|ms\njunk\nx:1|zz", sock_path)
+    listener.contribute({})
+    assert listener.value("api.req", "sum") == 2.0
+    assert listener.value("queue", "last") == 51.0 and listener.value("queue", "max") == 52.0
+    assert listener.value("db", "avg") == 20.0 and listener.value("db", "max") == 30.0
+    assert listener.bad == 2, listener.bad
+    # A quiet tick: counters and timers drop to zero, a gauge keeps its value
+    listener.contribute({})
+    assert listener.value("api.req", "sum") == 0.0 and listener.value("api.req", "rate") == 0.0
+    assert listener.value("db", "max") == 0.0 and listener.value("queue", "avg") == 51.0
+    assert listener.value("missing", "sum") is None
+    listener.close()
+    unix.close()
+    os.unlink(os.path.join(sock_dir, "notes.txt"))
+    os.rmdir(sock_dir)
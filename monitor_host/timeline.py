@@ -0,0 +1,178 @@
+"""Host + device timeline in Chrome trace format (chrome://tracing, Perfetto).
+
+The host records complete ("X") events for every stage of a tick: collection,
+each source and sink, JSON serialisation, the serial write and an estimate of
+the time the frame spends on the wire at the configured baud rate. Stats
+frames carry an "id"; the device answers each one with a {"t":"tr"} line
+holding micros() stamps for receive, parse, draw and push, and a flow arrow
+ties the host write to the device receive. The same echo feeds the latency
+histograms in latency.py.
+
+The device clock is mapped onto the host clock with ping/pong exchanges: the
+host sends its own timestamp, the device echoes it with micros(), and the
+offset is taken from the exchange with the smallest round trip seen recently
+(the device only reads serial between redraws, so most round trips are
+inflated by a draw and would skew the midpoint).
+
+Events are streamed to the file as they complete, so long traces do not grow
+memory; the file is closed with "]" on exit (viewers accept it without).
+"""
+import json
+import os
+import sys
+import time
+
+PING_INTERVAL = 2.0
+PING_WINDOW = 30
+MAX_PENDING = 256
+
+HOST_PID = 1
+DEVICE_PID = 2
+
+DEVICE_STAGES = (("rx", "uart rx"), ("ps", "parse"), ("dr", "draw"), ("pu", "push"))
+
+
+class DeviceClock:
+    """Maps device micros() stamps onto the host's time.monotonic()"""
+
+    def __init__(self):
+        self.t0 = time.monotonic()
+        # Pongs ever received (pings keeps only the last PING_WINDOW)
+        self.pongs = 0
+        self.reset()
+
+    def reset(self):
+        """Forget the alignment: a new link may be a rebooted device whose
+        micros() started again from zero"""
+        self.next_ping = 0.0
+        self.pings = []
+        self.offset = None
+        self.wrap = 0
+        self.last_dev = 0
+
+    def us(self, t):
+        """Host time in microseconds since the clock was created"""
+        return (t - self.t0) * 1e6
+
+    def ping_frame(self, now):
+        self.next_ping = now + PING_INTERVAL
+        return {"t": "ping", "h": round(self.us(now))}
+
+    def unwrap(self, dev_us):
+        # micros() is 32-bit and wraps every ~71 minutes
+        if dev_us < self.last_dev - (1 << 31):
+            self.wrap += 1 << 32
+        self.last_dev = dev_us
+        return dev_us + self.wrap
+
+    def pong(self, msg, now):
+        sent = msg["h"]
+        recv = self.us(now)
+        rtt = recv - sent
+        offset = self.unwrap(msg["d"]) - (sent + rtt / 2)
+        self.pongs += 1
+        self.pings.append((rtt, offset))
+        del self.pings[:-PING_WINDOW]
+        self.offset = min(self.pings)[1]
+        if len(self.pings) == 1:
+            print(f"Device clock aligned (rtt {rtt / 1000:.1f} ms)")
+
+    def host_us(self, dev_us):
+        """A device stamp in host microseconds (see us()); needs an offset"""
+        return self.unwrap(dev_us) - self.offset
+
+
+class Tracer:
+    def __init__(self, path, clock):
+        self.path = path
+        self.clock = clock
+        self.f = open(path, "w")
+        self.f.write("[")
+        self.first = True
+        self.pending = []
+        self.events = 0
+        for pid, name in ((HOST_PID, "host"), (DEVICE_PID, "device")):
+            self._emit({"ph": "M", "name": "process_name", "pid": pid, "tid": 1, "args": {"name": name}})
+        print(f"Tracing to {path}")
+
+    def _emit(self, event):
+        self.f.write(("\n" if self.first else ",\n") + json.dumps(event, separators=(",", ":")))
+        self.first = False
+        self.events += 1
+
+    def span(self, name, start, end=None, cat="host", args=None):
+        end = time.monotonic() if end is None else end
+        event = {"ph": "X", "name": name, "cat": cat, "pid": HOST_PID, "tid": 1,
+                 "ts": round(self.clock.us(start), 1), "dur": round((end - start) * 1e6, 1)}
+        if args:
+            event["args"] = args
+        self._emit(event)
+
+    def frame_written(self, frame_id, start, serialized, written, size, baud):
+        self.span("serialize", start, serialized, args={"bytes": size})
+        self.span("serial write", serialized, written)
+        # 10 bits per byte on an 8N1 UART; the OS returns before the bytes leave
+        wire = size * 10 / baud
+        self.span("uart tx (est)", written, written + wire, cat="wire")
+        self._emit({"ph": "s", "id": frame_id, "name": "frame", "cat": "frame", "pid": HOST_PID, "tid": 1,
+                    "ts": round(self.clock.us(written), 1)})
+
+    def reset(self):
+        """Drop device events held for an alignment that will not come"""
+        self.pending = []
+
+    def receive(self, msg, now):
+        kind = msg.get("t")
+        if kind == "pong":
+            for pending in self.pending:
+                self._device_events(pending)
+            self.pending = []
+        elif kind == "tr":
+            if self.clock.offset is None:
+                if len(self.pending) < MAX_PENDING:
+                    self.pending.append(msg)
+                return
+            self._device_events(msg)
+
+    def _device_events(self, msg):
+        frame_id = msg.get("id")
+        for key, name in DEVICE_STAGES:
+            stage = msg.get(key)
+            if not stage:
+                continue
+            ts = self.clock.host_us(stage[0])
+            self._emit({"ph": "X", "name": name, "cat": "device", "pid": DEVICE_PID, "tid": 1,
+                        "ts": round(ts, 1), "dur": stage[1], "args": {"frame": frame_id}})
+            if key == "rx" and frame_id:
+                self._emit({"ph": "f", "bp": "e", "id": frame_id, "name": "frame", "cat": "frame",
+                            "pid": DEVICE_PID, "tid": 1, "ts": round(ts, 1)})
+
+    def close(self):
+        self.f.write("\n]\n")
+        self.f.close()
+        print(f"Wrote {self.events} trace events to {self.path}")
+
+
+def summarize(path):
+    """Mean duration per stage from a written trace"""
+    with open(path) as f:
+        text = f.read().rstrip()
+    if not text.endswith("]"):
+        text = text.rstrip(",") + "]"
+    totals = {}
+    for e in json.loads(text):
+        if e.get("ph") == "X":
+            key = (e["pid"], e["name"])
+            n, s, mx = totals.get(key, (0, 0.0, 0.0))
+            totals[key] = (n + 1, s + e["dur"], max(mx, e["dur"]))
+    for (pid, name), (n, s, mx) in sorted(totals.items(), key=lambda kv: (kv[0][0], -kv[1][1])):
+        side = "device" if pid == DEVICE_PID else "host"
+        print(f"{side:6} {name:22} n={n:<6} avg {s / n / 1000:8.3f} ms  max {mx / 1000:8.3f} ms")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 2 and os.path.exists(sys.argv[1]):
+        summarize(sys.argv[1])
+    else:
+        print("usage: timeline.py TRACE.json   (record with monitor.py --trace TRACE.json)", file=sys.stderr)
+        sys.exit(2)
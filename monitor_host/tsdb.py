@@ -0,0 +1,445 @@
+"""Fixed-size memory-mapped ring store for every metric at native resolution.
+
+The file is columnar: one f64 timestamp column followed by one f32 column per
+metric, each `capacity` slots long. Appending writes one slot per column and
+then bumps the total sample count in the header, which is the commit point,
+so the file survives restarts without a write-ahead log. Readers map the file
+read-only and slice columns directly.
+
+    offset 0    magic "CYDR", u16 version, u16 reserved, u32 field count,
+                u32 capacity, f64 nominal interval, u64 total appended
+    offset 64   field names, NAME_LEN bytes each, NUL padded
+    DATA_OFF    f64 ts[capacity], then f32 values[capacity] per field
+"""
+import math
+import mmap
+import os
+import struct
+import sys
+import time
+
+from shm import NAME_LEN
+from registry import NAMES, reader
+
+DEFAULT_STORE_PATH = os.path.expanduser("~/.local/share/cyd-monitor/ring.dat")
+DEFAULT_CAPACITY = 24 * 3600
+
+MAGIC = b"CYDR"
+VERSION = 1
+HEADER = struct.Struct("<4sHHIId")
+COUNT = struct.Struct("<Q")
+COUNT_OFF = HEADER.size
+NAMES_OFF = 64
+TS = struct.Struct("<d")
+VAL = struct.Struct("<f")
+
+
+def _data_offset(nfields):
+    end = NAMES_OFF + nfields * NAME_LEN
+    return (end + mmap.PAGESIZE - 1) // mmap.PAGESIZE * mmap.PAGESIZE
+
+
+def _layout(nfields, capacity):
+    data_off = _data_offset(nfields)
+    col_offs = [data_off + capacity * 8 + i * capacity * 4 for i in range(nfields)]
+    return data_off, col_offs, data_off + capacity * 8 + nfields * capacity * 4
+
+
+def _read_header(mm, expect=MAGIC):
+    magic, version, _, nfields, capacity, interval = HEADER.unpack_from(mm, 0)
+    if magic != expect or version != VERSION:
+        raise ValueError("not a CYD ring store")
+    names = []
+    for i in range(nfields):
+        raw = mm[NAMES_OFF + i * NAME_LEN:NAMES_OFF + (i + 1) * NAME_LEN]
+        names.append(raw.split(b"\0", 1)[0].decode())
+    return names, capacity, interval
+
+
+def _open_mapped(path, magic, fields, capacity, interval, size):
+    """Map an existing file with the same layout, or start a fresh one"""
+    os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+    fd = os.open(path, os.O_RDWR | os.O_CREAT, 0o644)
+    try:
+        if os.fstat(fd).st_size == size:
+            mm = mmap.mmap(fd, size)
+            try:
+                names, cap, ivl = _read_header(mm, magic)
+                if names == fields and cap == capacity and ivl == interval:
+                    return mm
+            except ValueError:
+                pass
+            mm.close()
+        if os.fstat(fd).st_size:
+            print(f"{path}: layout changed, starting a new store", file=sys.stderr)
+        os.ftruncate(fd, 0)
+        os.ftruncate(fd, size)
+        mm = mmap.mmap(fd, size)
+        HEADER.pack_into(mm, 0, magic, VERSION, 0, len(fields), capacity, interval)
+        COUNT.pack_into(mm, COUNT_OFF, 0)
+        for i, name in enumerate(fields):
+            mm[NAMES_OFF + i * NAME_LEN:NAMES_OFF + (i + 1) * NAME_LEN] = \
+                name.encode()[:NAME_LEN - 1].ljust(NAME_LEN, b"\0")
+        return mm
+    finally:
+        os.close(fd)
+
+
+class RingStore:
+    """Sink that appends every sample to the ring file"""
+
+    def __init__(self, path=DEFAULT_STORE_PATH, fields=NAMES, capacity=DEFAULT_CAPACITY, interval=1.0):
+        self.path = path
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.capacity = capacity
+        self.interval = interval
+        self.data_off, self.col_offs, self.size = _layout(len(self.fields), capacity)
+        self.mm = _open_mapped(path, MAGIC, self.fields, capacity, interval, self.size)
+        self.count = COUNT.unpack_from(self.mm, COUNT_OFF)[0]
+        print(f"Recording to {path} ({self.count} samples retained)")
+
+    def publish(self, data, ts=None):
+        self.append(self.read(data), time.time() if ts is None else ts)
+
+    def append(self, values, ts):
+        slot = self.count % self.capacity
+        mm = self.mm
+        TS.pack_into(mm, self.data_off + slot * 8, ts)
+        pos = slot * 4
+        for off, v in zip(self.col_offs, values):
+            VAL.pack_into(mm, off + pos, v)
+        self.count += 1
+        COUNT.pack_into(mm, COUNT_OFF, self.count)
+
+    def close(self):
+        try:
+            self.mm.flush()
+            self.mm.close()
+        except (OSError, ValueError):
+            pass
+
+
+class RingReader:
+    """Read-only mapping of a ring store for range scans"""
+
+    def __init__(self, path=DEFAULT_STORE_PATH):
+        with open(path, "rb") as f:
+            self.mm = mmap.mmap(f.fileno(), 0, mmap.MAP_SHARED, mmap.PROT_READ)
+        self.fields, self.capacity, self.interval = _read_header(self.mm)
+        self.index = {name: i for i, name in enumerate(self.fields)}
+        self.data_off, self.col_offs, _ = _layout(len(self.fields), self.capacity)
+        view = memoryview(self.mm)
+        self.ts = view[self.data_off:self.data_off + self.capacity * 8].cast("d")
+        self.cols = [view[off:off + self.capacity * 4].cast("f") for off in self.col_offs]
+
+    def count(self):
+        return COUNT.unpack_from(self.mm, COUNT_OFF)[0]
+
+    def _window(self):
+        """Logical [first, last) sample numbers currently held"""
+        total = self.count()
+        # Leave one slot of slack: the writer may be overwriting the oldest
+        first = max(0, total - self.capacity + 1)
+        return first, total
+
+    def _ts_at(self, n):
+        return self.ts[n % self.capacity]
+
+    def _find(self, t, first, last):
+        lo, hi = first, last
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self._ts_at(mid) < t:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def span(self, t0, t1):
+        """Logical sample range covering [t0, t1]"""
+        first, last = self._window()
+        return self._find(t0, first, last), self._find(math.nextafter(t1, math.inf), first, last)
+
+    def range(self, name, t0=-math.inf, t1=math.inf):
+        """Return (timestamps, values) for one metric between t0 and t1"""
+        col = self.cols[self.index[name]]
+        a, b = self.span(t0, t1)
+        ts, vals = [], []
+        cap = self.capacity
+        while a < b:
+            # Copy contiguous runs so a wrapped range costs two slices
+            s = a % cap
+            e = min(cap, s + (b - a))
+            ts.extend(self.ts[s:e])
+            vals.extend(col[s:e])
+            a += e - s
+        return ts, vals
+
+    def latest(self):
+        total = self.count()
+        if not total:
+            return None, {}
+        slot = (total - 1) % self.capacity
+        return self.ts[slot], {name: self.cols[i][slot] for i, name in enumerate(self.fields)}
+
+    def close(self):
+        self.ts.release()
+        for c in self.cols:
+            c.release()
+        self.mm.close()
+
+
+ROLLUP_MAGIC = b"CYDU"
+# (bucket seconds, buckets kept): 24 h of 10 s, 7 days of 1 min, 30 days of 10 min
+ROLLUP_TIERS = ((10, 8640), (60, 7 * 1440), (600, 30 * 144))
+F64 = struct.Struct("<d")
+STATS = ("min", "max", "sum", "count")
+
+
+def _rollup_layout(nfields, capacity):
+    data_off = _data_offset(nfields)
+    col = capacity * 8
+    # Per field: min, max, sum, count columns of f64
+    field_offs = [data_off + col + i * 4 * col for i in range(nfields)]
+    return data_off, field_offs, data_off + col + nfields * 4 * col
+
+
+class RollupTier:
+    """Downsampled min/max/sum/count buckets for one bucket width"""
+
+    def __init__(self, path, fields, bucket, capacity, writable=True):
+        self.path = path
+        self.fields = list(fields)
+        self.bucket = bucket
+        self.capacity = capacity
+        self.data_off, self.field_offs, size = _rollup_layout(len(self.fields), capacity)
+        if writable:
+            self.mm = _open_mapped(path, ROLLUP_MAGIC, self.fields, capacity, float(bucket), size)
+        else:
+            with open(path, "rb") as f:
+                self.mm = mmap.mmap(f.fileno(), 0, mmap.MAP_SHARED, mmap.PROT_READ)
+            self.fields, self.capacity, _ = _read_header(self.mm, ROLLUP_MAGIC)
+            self.data_off, self.field_offs, _ = _rollup_layout(len(self.fields), self.capacity)
+        self.count = COUNT.unpack_from(self.mm, COUNT_OFF)[0]
+        self.cur_start = None
+        self.cur = None
+
+    def add(self, ts, values):
+        start = ts - ts % self.bucket
+        if start != self.cur_start:
+            self._commit()
+            self.cur_start = start
+            self.cur = [[math.inf, -math.inf, 0.0, 0] for _ in self.fields]
+        for acc, v in zip(self.cur, values):
+            if v != v:
+                continue
+            if v < acc[0]:
+                acc[0] = v
+            if v > acc[1]:
+                acc[1] = v
+            acc[2] += v
+            acc[3] += 1
+
+    def _commit(self):
+        """Write the finished in-memory bucket and bump the count"""
+        if self.cur is None:
+            return
+        slot = self.count % self.capacity
+        col = self.capacity * 8
+        TS.pack_into(self.mm, self.data_off + slot * 8, self.cur_start)
+        for off, acc in zip(self.field_offs, self.cur):
+            for k in range(4):
+                F64.pack_into(self.mm, off + k * col + slot * 8, acc[k])
+        self.count += 1
+        COUNT.pack_into(self.mm, COUNT_OFF, self.count)
+        self.cur = None
+
+    def _stored(self):
+        if self.cur is None:
+            self.count = COUNT.unpack_from(self.mm, COUNT_OFF)[0]
+        return max(0, self.count - self.capacity + 1), self.count
+
+    def oldest(self):
+        first, last = self._stored()
+        if first == last:
+            return self.cur_start if self.cur is not None else math.inf
+        return F64.unpack_from(self.mm, self.data_off + (first % self.capacity) * 8)[0]
+
+    def buckets(self, idx, t0, t1):
+        """Yield (start, min, max, sum, count) for one field, oldest first"""
+        first, last = self._stored()
+        col = self.capacity * 8
+        off = self.field_offs[idx]
+        # Bucket starts are increasing, so binary search the first one needed
+        lo, hi = first, last
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if F64.unpack_from(self.mm, self.data_off + (mid % self.capacity) * 8)[0] + self.bucket <= t0:
+                lo = mid + 1
+            else:
+                hi = mid
+        for n in range(lo, last):
+            slot = (n % self.capacity) * 8
+            start = F64.unpack_from(self.mm, self.data_off + slot)[0]
+            if start > t1:
+                return
+            yield (start,) + tuple(F64.unpack_from(self.mm, off + k * col + slot)[0] for k in range(4))
+        if self.cur is not None and t0 < self.cur_start + self.bucket and self.cur_start <= t1:
+            yield (self.cur_start,) + tuple(self.cur[idx])
+
+    def close(self):
+        try:
+            self._commit()
+            self.mm.close()
+        except (OSError, ValueError, TypeError):
+            pass
+
+
+class Rollups:
+    """Sink maintaining every tier on append, plus the range-query API"""
+
+    def __init__(self, base_path=DEFAULT_STORE_PATH, fields=NAMES, tiers=ROLLUP_TIERS,
+                 ring_path=None, writable=True):
+        self.fields = list(fields)
+        self.read = reader(self.fields)
+        self.tiers = [RollupTier(f"{base_path}.{bucket}s", self.fields, bucket, capacity, writable)
+                      for bucket, capacity in tiers]
+        if not writable:
+            self.fields = self.tiers[0].fields
+        self.index = {name: i for i, name in enumerate(self.fields)}
+        self.ring_path = ring_path
+
+    def publish(self, data, ts=None):
+        values = self.read(data)
+        ts = time.time() if ts is None else ts
+        for tier in self.tiers:
+            tier.add(ts, values)
+
+    def pick_tier(self, resolution):
+        """Coarsest tier whose buckets are no wider than the resolution"""
+        best = None
+        for tier in self.tiers:
+            if tier.bucket <= resolution and (best is None or tier.bucket > best.bucket):
+                best = tier
+        return best
+
+    def query(self, name, t0, t1, resolution):
+        """Return [(start, min, max, avg, count)] at the requested resolution"""
+        idx = self.index[name]
+        tier = self.pick_tier(resolution)
+        if tier is None:
+            if not self.ring_path:
+                tier = min(self.tiers, key=lambda t: t.bucket)
+            else:
+                reader = RingReader(self.ring_path)
+                try:
+                    ts, vals = reader.range(name, t0, t1)
+                finally:
+                    reader.close()
+                return [(t, v, v, v, 1) for t, v in zip(ts, vals) if v == v]
+        return [(start, mn, mx, sm / ct, ct)
+                for start, mn, mx, sm, ct in tier.buckets(idx, t0, t1) if ct]
+
+    def series(self, name, t0, t1, points):
+        """Resample [t0, t1) into exactly `points` (min, max, avg) columns"""
+        width = (t1 - t0) / points
+        out = [[math.inf, -math.inf, 0.0, 0] for _ in range(points)]
+        for start, mn, mx, avg, ct in self.query(name, t0, t1, width):
+            i = int((start - t0) // width)
+            if 0 <= i < points:
+                acc = out[i]
+                acc[0] = min(acc[0], mn)
+                acc[1] = max(acc[1], mx)
+                acc[2] += avg * ct
+                acc[3] += ct
+        return [(a[0], a[1], a[2] / a[3]) if a[3] else None for a in out]
+
+    def close(self):
+        for tier in self.tiers:
+            tier.close()
+
+
+HIST_POINTS = 150
+
+
+class HistoryFeed:
+    """Periodically sends the device a pre-aggregated series for its graph"""
+
+    def __init__(self, rollups, field="cpu.load", span=3600, period=10.0, points=HIST_POINTS):
+        self.rollups = rollups
+        self.field = field
+        self.span = span
+        self.period = period
+        self.points = points
+        self.next_send = 0.0
+
+    def frames(self, now):
+        if now < self.next_send:
+            return []
+        self.next_send = now + self.period
+        t1 = time.time()
+        cols = self.rollups.series(self.field, t1 - self.span, t1, self.points)
+        present = [c for c in cols if c is not None]
+        if not present:
+            return []
+        lo = math.floor(min(c[0] for c in present))
+        hi = math.ceil(max(c[1] for c in present))
+        if hi <= lo:
+            hi = lo + 1
+        scale = 254.0 / (hi - lo)
+
+        # One byte per column, hex encoded; FF marks a column with no data
+        def enc(k):
+            return "".join("ff" if c is None else f"{int((c[k] - lo) * scale + 0.5):02x}" for c in cols)
+
+        return [{"t": "hist", "n": self.field, "span": self.span, "lo": lo, "hi": hi,
+                 "mn": enc(0), "mx": enc(1), "av": enc(2)}]
+
+
+def main():
+    import argparse
+    parser = argparse.ArgumentParser(description="Query the ring store written by monitor.py --store")
+    parser.add_argument("field", nargs="?", help="Metric to summarise (lists fields when omitted)")
+    parser.add_argument("--path", default=DEFAULT_STORE_PATH)
+    parser.add_argument("--since", type=float, default=3600, help="Seconds of history (default 3600)")
+    parser.add_argument("--bench", action="store_true", help="Time a full-range scan of the field")
+    parser.add_argument("--resolution", type=float, default=None,
+                        help="Answer from the coarsest rollup tier at this many seconds per bucket")
+    args = parser.parse_args()
+
+    if args.field and args.resolution:
+        rollups = Rollups(args.path, ring_path=args.path, writable=False)
+        t1 = time.time()
+        rows = rollups.query(args.field, t1 - args.since, t1, args.resolution)
+        if not rows:
+            print("no samples")
+            return
+        peak = max(rows, key=lambda r: r[2])
+        count = sum(r[4] for r in rows)
+        avg = sum(r[3] * r[4] for r in rows) / count
+        print(f"{args.field}: buckets={len(rows)} min={min(r[1] for r in rows):g} "
+              f"max={peak[2]:g} at {time.strftime('%Y-%m-%d %H:%M', time.localtime(peak[0]))} avg={avg:g}")
+        return
+
+    reader = RingReader(args.path)
+    if not args.field:
+        first, last = reader._window()
+        print(f"{last - first} samples, capacity {reader.capacity}")
+        print("\n".join(reader.fields))
+        return
+    t1 = time.time()
+    start = time.perf_counter()
+    ts, vals = reader.range(args.field, -math.inf if args.bench else t1 - args.since, t1)
+    elapsed = time.perf_counter() - start
+    vals = [v for v in vals if v == v]
+    if not vals:
+        print("no samples")
+        return
+    print(f"{args.field}: n={len(vals)} min={min(vals):g} max={max(vals):g} avg={sum(vals) / len(vals):g}")
+    if args.bench:
+        print(f"scan: {elapsed * 1000:.2f} ms ({elapsed / max(len(ts), 1) * 1e9:.0f} ns/sample)")
+
+
+if __name__ == "__main__":
+    main()
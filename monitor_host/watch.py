@@ -0,0 +1,312 @@
+"""High-rate collector for one watched service.
+
+Targets are resolved by PID, process name or cgroup, and the collector keeps
+file descriptors to /proc/<pid>/{stat,status,io} and the task and fd
+directories open, re-reading them with pread. Work per sample is
+proportional to the watched threads: a name target is resolved with one
+/proc scan at start and again only when a tracked process exits (or none is
+tracked), which also follows a restarted service. A cgroup target re-reads
+its cgroup.procs every RESOLVE_INTERVAL to pick up new workers. A PID target
+is resolved once; a restarted process has a new PID and is not followed.
+Rates are summed from per-process deltas. Per-thread CPU ticks are parsed by
+the optional _fastproc extension when it is built.
+"""
+import errno
+import os
+import sys
+import time
+
+try:
+    import _fastproc
+except ImportError:
+    _fastproc = None
+
+PROC = "/proc"
+CGROUP_ROOT = "/sys/fs/cgroup"
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+PAGE_SIZE = os.sysconf("SC_PAGE_SIZE")
+READ_SIZE = 4096
+RESOLVE_INTERVAL = 1.0
+TOP_THREADS = 5
+
+_GONE = (errno.ESRCH, errno.ENOENT)
+
+
+def _stat_fields(raw):
+    """Split /proc/<pid>/stat, keeping a comm that contains spaces intact"""
+    close = raw.rfind(b")")
+    comm = raw[raw.find(b"(") + 1:close]
+    # Fields after comm start at field 3 (state)
+    return comm, raw[close + 2:].split()
+
+
+class _Proc:
+    """Open descriptors for one watched process"""
+
+    def __init__(self, pid):
+        self.pid = pid
+        self.stat_fd = self.status_fd = self.io_fd = self.task_fd = self.fd_dir_fd = None
+        self.threads = {}  # tid -> [stat fd, name, last ticks]
+        # (ticks, context switches, read bytes, write bytes) at the last sample
+        self.prev = None
+        self.dir_fd = os.open(f"{PROC}/{pid}", os.O_RDONLY | os.O_DIRECTORY)
+        try:
+            self.stat_fd = os.open("stat", os.O_RDONLY, dir_fd=self.dir_fd)
+            self.status_fd = os.open("status", os.O_RDONLY, dir_fd=self.dir_fd)
+            try:
+                self.io_fd = os.open("io", os.O_RDONLY, dir_fd=self.dir_fd)
+            except PermissionError:
+                pass
+            self.task_fd = os.open("task", os.O_RDONLY | os.O_DIRECTORY, dir_fd=self.dir_fd)
+            try:
+                self.fd_dir_fd = os.open("fd", os.O_RDONLY | os.O_DIRECTORY, dir_fd=self.dir_fd)
+            except PermissionError:
+                pass
+            comm, fields = _stat_fields(os.pread(self.stat_fd, READ_SIZE, 0))
+        except OSError:
+            # Exited between the opens (ENOENT, ESRCH ...): release what was opened
+            self.close()
+            raise
+        self.name = comm.decode(errors="replace")
+        self.start_time = fields[19]
+
+    def read_stat(self):
+        return _stat_fields(os.pread(self.stat_fd, READ_SIZE, 0))[1]
+
+    def read_status(self):
+        out = {}
+        for line in os.pread(self.status_fd, READ_SIZE, 0).split(b"\n"):
+            key, _, value = line.partition(b":")
+            if key in (b"VmRSS", b"voluntary_ctxt_switches", b"nonvoluntary_ctxt_switches"):
+                out[key] = int(value.split()[0])
+        return out
+
+    def read_io(self):
+        if self.io_fd is None:
+            return 0, 0
+        rd = wr = 0
+        for line in os.pread(self.io_fd, READ_SIZE, 0).split(b"\n"):
+            if line.startswith(b"read_bytes:"):
+                rd = int(line[11:])
+            elif line.startswith(b"write_bytes:"):
+                wr = int(line[12:])
+        return rd, wr
+
+    def count_fds(self):
+        if self.fd_dir_fd is None:
+            return 0
+        return len(os.listdir(self.fd_dir_fd))
+
+    def sample_threads(self, dt):
+        """Return [(name, cpu%)] for live threads, opening new ones lazily"""
+        live = set(int(t) for t in os.listdir(self.task_fd))
+        for tid in list(self.threads):
+            if tid not in live:
+                os.close(self.threads.pop(tid)[0])
+        out = []
+        for tid in live:
+            entry = self.threads.get(tid)
+            try:
+                if entry is None:
+                    fd = os.open(f"{tid}/stat", os.O_RDONLY, dir_fd=self.task_fd)
+                    comm, fields = _stat_fields(os.pread(fd, READ_SIZE, 0))
+                    entry = self.threads[tid] = [fd, comm.decode(errors="replace"), int(fields[11]) + int(fields[12])]
+                    continue
+                if _fastproc:
+                    ticks = _fastproc.task_ticks(entry[0])
+                else:
+                    fields = _stat_fields(os.pread(entry[0], READ_SIZE, 0))[1]
+                    ticks = int(fields[11]) + int(fields[12])
+            except OSError:
+                # Thread exited between listdir and read
+                continue
+            out.append((entry[1], (ticks - entry[2]) * 100.0 / CLK_TCK / dt))
+            entry[2] = ticks
+        return out
+
+    def close(self):
+        for fd, _, _ in self.threads.values():
+            os.close(fd)
+        self.threads.clear()
+        for fd in (self.stat_fd, self.status_fd, self.io_fd, self.task_fd, self.fd_dir_fd, self.dir_fd):
+            if fd is not None:
+                try:
+                    os.close(fd)
+                except OSError:
+                    pass
+
+
+def find_pids_by_name(name):
+    """One full /proc scan, only used to (re)resolve a target"""
+    pids = []
+    encoded = name.encode()[:15]
+    for entry in os.listdir(PROC):
+        if not entry.isdigit():
+            continue
+        try:
+            with open(f"{PROC}/{entry}/comm", "rb") as f:
+                if f.read().rstrip(b"\n") == encoded:
+                    pids.append(int(entry))
+        except OSError:
+            continue
+    return sorted(pids)
+
+
+def cgroup_pids(path):
+    with open(os.path.join(CGROUP_ROOT, path.lstrip("/"), "cgroup.procs")) as f:
+        return [int(line) for line in f if line.strip()]
+
+
+class WatchCollector:
+    """Sampler + source for a single watched service"""
+    name = "watch"
+
+    def __init__(self, target, hz=5.0):
+        self.target = target
+        self.interval = 1.0 / hz
+        self.next_due = 0.0
+        self.procs = {}
+        self.last_resolve = 0.0
+        # A tracked process exited since the last resolve
+        self.lost = False
+        self.last_sample = None
+        self.cpu = 0.0
+        self.cpu_peak = 0.0
+        self.latest = {}
+        self.top = []
+        self.restarts = 0
+        self._resolve(time.monotonic())
+
+    def _target_pids(self):
+        if self.target.isdigit():
+            return [int(self.target)]
+        if self.target.startswith("cgroup:"):
+            return cgroup_pids(self.target[7:])
+        return find_pids_by_name(self.target)
+
+    def _resolve(self, now):
+        self.last_resolve = now
+        self.lost = False
+        try:
+            pids = self._target_pids()
+        except OSError as e:
+            print(f"Watch {self.target}: {e}", file=sys.stderr)
+            return
+        had = bool(self.procs)
+        if not self.target.isdigit():
+            # Processes that left the cgroup or were renamed; exits are
+            # noticed by sample() itself
+            for pid in set(self.procs) - set(pids):
+                self._drop(pid)
+        for pid in pids:
+            if pid in self.procs:
+                continue
+            try:
+                self.procs[pid] = _Proc(pid)
+            except OSError:
+                continue
+        if self.procs and not had and self.last_sample is not None:
+            self.restarts += 1
+            print(f"Watch {self.target}: now tracking pid {min(self.procs)}")
+
+    def _drop(self, pid):
+        self.procs.pop(pid).close()
+
+    def sample(self, now=None):
+        now = time.monotonic() if now is None else now
+        # cgroup.procs is cheap to re-read; a name target costs a /proc scan,
+        # so it is resolved again only once a tracked process is gone
+        if not self.target.isdigit() and now - self.last_resolve >= RESOLVE_INTERVAL:
+            if self.target.startswith("cgroup:") or self.lost or not self.procs:
+                self._resolve(now)
+        if not self.procs:
+            self.latest = {}
+            return
+
+        dt = (now - self.last_sample) if self.last_sample else self.interval
+        rss = fds = 0
+        # Rates come from per-process deltas, so a process joining or
+        # leaving the target does not disturb them
+        deltas = [0, 0, 0, 0]
+        have_delta = False
+        threads = []
+        for pid in list(self.procs):
+            proc = self.procs[pid]
+            try:
+                fields = proc.read_stat()
+                if fields[19] != proc.start_time:
+                    raise ProcessLookupError
+                status = proc.read_status()
+                io = proc.read_io()
+                fds += proc.count_fds()
+                threads += proc.sample_threads(dt)
+            except OSError as e:
+                if isinstance(e, ProcessLookupError) or e.errno in _GONE:
+                    self._drop(pid)
+                    self.lost = True
+                    continue
+                raise
+            counters = (int(fields[11]) + int(fields[12]),
+                        status.get(b"voluntary_ctxt_switches", 0) + status.get(b"nonvoluntary_ctxt_switches", 0),
+                        io[0], io[1])
+            if proc.prev is not None:
+                have_delta = True
+                for i, (c, p) in enumerate(zip(counters, proc.prev)):
+                    deltas[i] += max(c - p, 0)
+            proc.prev = counters
+            rss += status.get(b"VmRSS", 0)
+
+        if not self.procs:
+            self.latest = {}
+            self.last_sample = now
+            return
+
+        if have_delta:
+            self.cpu = deltas[0] * 100.0 / CLK_TCK / dt
+            self.cpu_peak = max(self.cpu_peak, self.cpu)
+            self.latest = {
+                "cpu": self.cpu,
+                "rss": rss / 1024.0,
+                "fds": fds,
+                "thr": len(threads),
+                "cs": deltas[1] / dt,
+                "rd": deltas[2] / 1024.0 / dt,
+                "wr": deltas[3] / 1024.0 / dt,
+            }
+            threads.sort(key=lambda t: -t[1])
+            self.top = threads[:TOP_THREADS]
+        self.last_sample = now
+
+    def contribute(self, data):
+        first = self.procs[min(self.procs)] if self.procs else None
+        frame = {"n": first.name[:12] if first else self.target[:12],
+                 "pid": first.pid if first else 0,
+                 "up": int(bool(self.latest)),
+                 "rs": self.restarts}
+        if self.latest:
+            frame.update({k: round(v, 1) for k, v in self.latest.items()})
+            frame["pk"] = round(self.cpu_peak, 1)
+            frame["top"] = [[name[:10], round(cpu, 1)] for name, cpu in self.top]
+        # Peak is per display frame, not since start
+        self.cpu_peak = self.cpu
+        data["watch"] = frame
+
+    def close(self):
+        for pid in list(self.procs):
+            self._drop(pid)
+
+
+if __name__ == "__main__":
+    target = sys.argv[1] if len(sys.argv) > 1 else str(os.getpid())
+    w = WatchCollector(target, hz=10)
+    n = 50
+    start = time.process_time()
+    for _ in range(n):
+        time.sleep(w.interval)
+        w.sample()
+    cost = (time.process_time() - start) / n
+    frame = {}
+    w.contribute(frame)
+    print(frame["watch"])
+    print(f"{cost * 1e6:.0f} us CPU per sample")
+    w.close()